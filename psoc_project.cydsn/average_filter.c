@@ -5,41 +5,81 @@
 * @company Metropolia University of Applied Sciences
 * @date    07.04.2022
 *
-* This file provides basic interface for the simplest filter: average filter.
-* The samples are saved to the running sum and the filtered result is an average of saved samples.
-* The filter clears running sum once .filter_length is reached.
+* This file provides average filter of continuous stream of samples: CIC filter.
+* It is a cascade of CIC_STAGES
+* integrators running at input rate and CIC_STAGES combs running at output rate,
+* equivalent to CIC_STAGES cascaded boxcar averages of .decimation samples.
+* Arithmetic is integer only and wraps modulo 2^32, which is harmless as long as
+* |sample| * decimation^CIC_STAGES fits into int32.
+* Output is updated every .decimation samples and is always valid: until the cascade
+* is filled, plain average of all samples is returned.
 *
 *******************************************************************************/
 
 #include "average_filter.h"
+#include <string.h>
 
 /*
- * @brief Update the filter with new sample
+ * @brief Initialize CIC filter as empty
  * @param filter     Target filter
- * @param new_sample Target sample
+ * @param decimation Decimation ratio, number of input samples per output
  */
-void add_sample_to_filter(AverageFilter* filter, const int new_sample)
+void init_cic_filter(CicFilter* filter, uint32 decimation)
 {
-    // Reset the filter if the window is fully filled
-    if (filter->sample_number == filter->filter_length) {
-        filter->running_sum = 0;
-        filter->sample_number = 0;
-    }
+    memset(filter, 0, sizeof(CicFilter));
+    filter->decimation = decimation ? decimation : 1;
+}
 
-    // Update the filter
-    filter->running_sum += new_sample;
-    filter->sample_number++;
+/*
+ * @brief  Update CIC filter with new sample
+ * @param  filter     Target filter
+ * @param  new_sample Target sample
+ * @return            True if new output was produced
+ */
+uint8 add_sample_to_cic_filter(CicFilter* filter, const int32 new_sample)
+{
+    /* Integrators at input rate */
+    uint32 value = (uint32)new_sample;
+    for (uint8 i = 0; i < CIC_STAGES; i++) {
+        filter->integrators[i] += value;
+        value = filter->integrators[i];
+    }
+    
+    // Plain average is used until the cascade is filled
+    if (filter->outputs < CIC_STAGES) filter->warmup_sum += new_sample;
+    
+    if (++filter->phase < filter->decimation) return 0;
+    filter->phase = 0;
+    
+    /* Combs at output rate */
+    for (uint8 i = 0; i < CIC_STAGES; i++) {
+        uint32 previous = filter->combs[i];
+        filter->combs[i] = value;
+        value -= previous;
+    }
+    filter->outputs++;
+    
+    /* Remove gain of the cascade, decimation^CIC_STAGES */
+    if (filter->outputs >= CIC_STAGES) {
+        int32 result = (int32)value;
+        for (uint8 i = 0; i < CIC_STAGES; i++) {
+            result /= (int32)filter->decimation;
+        }
+        filter->result = result;
+    }
+    else {
+        filter->result = filter->warmup_sum / (filter->outputs * filter->decimation);
+    }
+    
+    return 1;
 }
 
 /*
- * @brief  Get filtered result (average) of the current samples collected
+ * @brief  Get the last output of CIC filter
  * @param  filter Target filter
- * @return        Filtered result (average)
+ * @return        Filtered result, 0 before the first output
  */
-int get_filtered_result(AverageFilter* filter)
+int32 get_cic_filtered_result(CicFilter* filter)
 {
-    // Avoid zero-division if filter is empty
-    if (filter->sample_number == 0) return 0;
-    
-    return filter->running_sum / filter->sample_number;
-}
\ No newline at end of file
+    return filter->result;
+}
@@ -5,9 +5,14 @@
 * @company Metropolia University of Applied Sciences
 * @date    07.04.2022
 *
-* This file provides basic interface for the simplest filter: average filter.
-* The samples are saved to the running sum and the filtered result is an average of saved samples.
-* The filter clears running sum once .filter_length is reached.
+* This file provides average filter of continuous stream of samples: CIC filter.
+* It is a cascade of CIC_STAGES
+* integrators running at input rate and CIC_STAGES combs running at output rate,
+* equivalent to CIC_STAGES cascaded boxcar averages of .decimation samples.
+* Arithmetic is integer only and wraps modulo 2^32, which is harmless as long as
+* |sample| * decimation^CIC_STAGES fits into int32.
+* Output is updated every .decimation samples and is always valid: until the cascade
+* is filled, plain average of all samples is returned.
 *
 *******************************************************************************/
 
@@ -17,14 +22,21 @@
 
 #include "project.h"
 
-typedef struct AverageFilter {
-    uint32 filter_length;  // Filter length
-    uint32 sample_number;  // Number of recorded samples
-    int64 running_sum;     // Running sum of the samples
-} AverageFilter;
+#define CIC_STAGES 3  // Number of integrator/comb pairs
+
+typedef struct CicFilter {
+    uint32 decimation;                // Decimation ratio, number of input samples per output
+    uint32 phase;                     // Input samples since the last output
+    uint32 integrators[CIC_STAGES];   // Integrator states, wrap modulo 2^32
+    uint32 combs[CIC_STAGES];         // Previous comb inputs
+    uint32 outputs;                   // Number of produced outputs
+    int32  result;                    // Last output in input units
+    int64  warmup_sum;                // Sum of the samples until the cascade is filled
+} CicFilter;
 
 /* Function declarations */
-void add_sample_to_filter(AverageFilter* filter, const int new_sample);
-int get_filtered_result(AverageFilter* filter);
+void  init_cic_filter(CicFilter* filter, uint32 decimation);
+uint8 add_sample_to_cic_filter(CicFilter* filter, const int32 new_sample);
+int32 get_cic_filtered_result(CicFilter* filter);
 
 #endif
\ No newline at end of file
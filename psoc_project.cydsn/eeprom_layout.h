@@ -0,0 +1,33 @@
+/******************************************************************************
+*
+* @name    TX00DB04 - Programmable System on Chip Design. EEPROM Layout
+* @company Metropolia University of Applied Sciences
+*
+* Map of EEPROM regions. Modules define format and size of the data they store,
+* placement of all regions is kept in this header, so they can not overlap.
+*
+*   EEPROM_INFO_ADDR_MSB           Device time checkpoint, first row
+*   EEPROM_INFO_SEQUENCE_ADDR_MSB  Sequence number of the next record at the checkpoint, same row
+*   EEPROM_DATA_START_ADDR         Sample records, up to EEPROM_DATA_END_ADDR
+*   MOISTURE_CALIB_ADDR            Calibration of every moisture probe
+*   SOIL_TEMP_ROM_TABLE_ADDR       OneWire ROM table cache, up to the end of EEPROM
+*
+*******************************************************************************/
+
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+
+#include "eeprom_writer.h"
+#include "temperature_soil.h"
+#include "moisture_sensor.h"
+
+#define EEPROM_INFO_ADDR_MSB          0x00
+#define EEPROM_INFO_SEQUENCE_ADDR_MSB 0x04                 // Saved in the same row write as the timestamp
+#define EEPROM_DATA_START_ADDR        EEPROM_ROW_SIZE      // Records do not share the row with the timestamp
+#define EEPROM_DATA_END_ADDR          MOISTURE_CALIB_ADDR  // Moisture calibration and OneWire ROM table are at the end
+#define MOISTURE_CALIB_ADDR           (SOIL_TEMP_ROM_TABLE_ADDR - MOISTURE_CALIB_SIZE * NUMBER_OF_MOISTURE_PROBES)
+#define SOIL_TEMP_ROM_TABLE_ADDR      (CYDEV_EE_SIZE - SOIL_TEMP_ROM_TABLE_SIZE)
+
+
+#endif
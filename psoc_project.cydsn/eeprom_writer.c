@@ -0,0 +1,79 @@
+/******************************************************************************
+*
+* @name    TX00DB04 - Programmable System on Chip Design. EEPROM Row Writer
+* @company Metropolia University of Applied Sciences
+*
+* EEPROM of PSoC 5LP is programmed by rows of EEPROM_ROW_SIZE bytes. Every
+* EEPROM_WriteByte() call erases and programs the whole row, so writing a block
+* byte by byte costs one row cycle per byte.
+* Row writer stages the block in a RAM row image: the bytes of the row outside of
+* the block are taken from EEPROM, the block is merged in and the row is committed
+* by a single EEPROM_Write(). Rows already holding the data are not written at all.
+* Number of physical row writes is counted to monitor the wear of the memory.
+*
+*******************************************************************************/
+
+#include "eeprom_writer.h"
+#include <string.h>
+
+/* Row writer state */
+static uint8  row_image[EEPROM_ROW_SIZE];  // RAM image of the row being written
+static uint32 total_row_writes = 0;        // Number of row writes since the start
+
+/*
+ * @brief  Write block of bytes to EEPROM, each touched row is written once
+ * @param  address    Address of the first byte
+ * @param  data       Bytes to write
+ * @param  length     Number of bytes
+ * @param  row_writes Number of physical row writes done, may be NULL
+ * @return            True on success
+ */
+uint8 write_eeprom_block(uint16 address, const uint8* data, uint16 length, uint8* row_writes)
+{
+    uint8 writes = 0;
+    uint8 success = 1;
+    
+    if (row_writes != NULL) *row_writes = 0;
+    if ((uint32)address + length > (uint32)EEPROM_ROW_SIZE * EEPROM_ROW_COUNT) return 0;
+    
+    while (length > 0) {
+        uint8 row    = address / EEPROM_ROW_SIZE;
+        uint8 offset = address % EEPROM_ROW_SIZE;
+        uint8 count  = EEPROM_ROW_SIZE - offset;
+        if (count > length) count = length;
+        
+        /* Stage the row, bytes outside of the block keep their values */
+        uint8 changed = 0;
+        for (uint8 i = 0; i < EEPROM_ROW_SIZE; i++) {
+            row_image[i] = EEPROM_ReadByte(row * EEPROM_ROW_SIZE + i);
+        }
+        for (uint8 i = 0; i < count; i++) {
+            changed |= row_image[offset + i] != data[i];
+            row_image[offset + i] = data[i];
+        }
+        
+        /* Commit the row, unchanged rows cost no erase cycle */
+        if (changed) {
+            if (EEPROM_Write(row_image, row) != CYRET_SUCCESS) success = 0;
+            writes++;
+        }
+        
+        address += count;
+        data    += count;
+        length  -= count;
+    }
+    
+    total_row_writes += writes;
+    if (row_writes != NULL) *row_writes = writes;
+    
+    return success;
+}
+
+/*
+ * @brief  Get number of row writes since the start
+ * @return Number of row writes
+ */
+uint32 get_eeprom_row_writes()
+{
+    return total_row_writes;
+}
@@ -0,0 +1,30 @@
+/******************************************************************************
+*
+* @name    TX00DB04 - Programmable System on Chip Design. EEPROM Row Writer
+* @company Metropolia University of Applied Sciences
+*
+* EEPROM of PSoC 5LP is programmed by rows of EEPROM_ROW_SIZE bytes. Every
+* EEPROM_WriteByte() call erases and programs the whole row, so writing a block
+* byte by byte costs one row cycle per byte.
+* Row writer stages the block in a RAM row image: the bytes of the row outside of
+* the block are taken from EEPROM, the block is merged in and the row is committed
+* by a single EEPROM_Write(). Rows already holding the data are not written at all.
+* Number of physical row writes is counted to monitor the wear of the memory.
+*
+*******************************************************************************/
+
+#ifndef EEPROM_WRITER_H
+#define EEPROM_WRITER_H
+
+
+#include "project.h"
+
+#define EEPROM_ROW_SIZE  CYDEV_EEPROM_ROW_SIZE  // Bytes programmed by one row write
+#define EEPROM_ROW_COUNT CY_EEPROM_NUMBER_ROWS  // Number of rows of the memory
+
+/* Function declarations */
+uint8  write_eeprom_block(uint16 address, const uint8* data, uint16 length, uint8* row_writes);
+uint32 get_eeprom_row_writes();
+
+
+#endif
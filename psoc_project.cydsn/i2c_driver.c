@@ -6,16 +6,65 @@
  * @date    14.05.2022
  *
  * Simple interface for interacting with I2C bus.
- * This interface only allows to read one byte from specified slave->register
+ * Transactions are queued and executed by the interrupt driven I2C component,
+ * i2c_service() advances the queue from the main loop.
  *
- * The communication template:
- * S | SLAVEADDR | W | REGADDR | ACK | RS | R | DATA | NAK | ST
+ * The communication template of the transaction:
+ * S | SLAVEADDR | W | DATA... | RS | SLAVEADDR | R | DATA... | NAK | ST
+ * Write or read part can be omitted.
  *
  * ========================================
 */
 
 #include "i2c_driver.h"
 
+/* Master status bits reporting failed transfer */
+#define I2C_MSTAT_ERRORS (I2C_MSTAT_ERR_SHORT_XFER | I2C_MSTAT_ERR_ADDR_NAK | \
+                          I2C_MSTAT_ERR_ARB_LOST | I2C_MSTAT_ERR_XFER)
+
+/* Queue engine states */
+typedef enum {
+    I2C_ENGINE_IDLE,     // Waiting for the transaction
+    I2C_ENGINE_WRITING,  // Write part is being transferred
+    I2C_ENGINE_READING   // Read part is being transferred
+} I2CEngineState;
+
+/* Queue globals */
+static I2CTransaction* queue[I2C_QUEUE_LENGTH];
+static uint8 queue_head = 0;  // Index of the transaction in progress
+static uint8 queue_tail = 0;  // Index of the next free queue place
+static I2CEngineState engine_state = I2C_ENGINE_IDLE;
+
+/*
+ * @brief Complete the transaction in progress and release the queue place
+ * @param status I2C_TR_DONE or I2C_TR_ERROR
+ * @param error  Error reason
+ */
+static void finish_transaction(uint8 status, uint8 error)
+{
+    I2CTransaction* transaction = queue[queue_head];
+    
+    transaction->error  = error;
+    transaction->status = status;
+    
+    queue_head = (queue_head + 1) % I2C_QUEUE_LENGTH;
+    engine_state = I2C_ENGINE_IDLE;
+}
+
+/*
+ * @brief  Start the read part of the transaction in progress
+ * @param  mode I2C_MODE_COMPLETE_XFER or I2C_MODE_REPEAT_START
+ * @return      Start error code
+ */
+static uint8 start_reading(uint8 mode)
+{
+    I2CTransaction* transaction = queue[queue_head];
+    
+    I2C_MasterClearStatus();
+    engine_state = I2C_ENGINE_READING;
+    return I2C_MasterReadBuf(transaction->slave_address, transaction->read_data, transaction->read_len, mode);
+}
+
 /*
  * @bried Initialize dependencies needed for I2C abstraction.
  * This includes I2C hardware.
@@ -26,32 +75,145 @@ void initialize_i2c()
 }
 
 /*
- * @brief Read i2c data from the slave
+ * @brief  Add the transaction to the queue
+ * @param  transaction Transaction to execute, must stay valid until completed
+ * @return             True if the transaction was queued
+ */
+uint8 i2c_submit(I2CTransaction* transaction)
+{
+    uint8 next_tail = (queue_tail + 1) % I2C_QUEUE_LENGTH;
+    if (next_tail == queue_head) return 0;  // Queue is full
+    if (transaction->write_len > I2C_MAX_DATA_LEN || transaction->read_len > I2C_MAX_DATA_LEN) return 0;
+    
+    transaction->status = I2C_TR_QUEUED;
+    transaction->error  = I2C_MSTR_NO_ERROR;
+    queue[queue_tail] = transaction;
+    queue_tail = next_tail;
+    
+    return 1;
+}
+
+/*
+ * @brief Advance the queue.
+ * Bytes are transferred by the I2C component interrupt, this function only
+ * checks completion of the current part and starts the next one.
+ * Call it from the main loop.
+ */
+void i2c_service()
+{
+    I2CTransaction* transaction = queue[queue_head];
+    uint8 status;
+    
+    switch (engine_state) {
+    case I2C_ENGINE_IDLE:
+        if (queue_head == queue_tail) return;
+        
+        /* Start the first part of the next transaction */
+        if (transaction->write_len) {
+            I2C_MasterClearStatus();
+            engine_state = I2C_ENGINE_WRITING;
+            status = I2C_MasterWriteBuf(transaction->slave_address, transaction->write_data, transaction->write_len,
+                                        transaction->read_len ? I2C_MODE_NO_STOP : I2C_MODE_COMPLETE_XFER);
+        }
+        else {
+            status = start_reading(I2C_MODE_COMPLETE_XFER);
+        }
+        
+        // Bus is occupied by another master, try again on the next call
+        if (status == I2C_MSTR_BUS_BUSY) engine_state = I2C_ENGINE_IDLE;
+        else if (status != I2C_MSTR_NO_ERROR) finish_transaction(I2C_TR_ERROR, status);
+        break;
+        
+    case I2C_ENGINE_WRITING:
+        status = I2C_MasterStatus();
+        if (status & I2C_MSTAT_XFER_INP) return;
+        if (status & I2C_MSTAT_ERRORS) {
+            finish_transaction(I2C_TR_ERROR, status & I2C_MSTAT_ERRORS);
+            return;
+        }
+        if (!(status & (I2C_MSTAT_WR_CMPLT | I2C_MSTAT_XFER_HALT))) return;
+        
+        if (!transaction->read_len) {
+            finish_transaction(I2C_TR_DONE, I2C_MSTR_NO_ERROR);
+            return;
+        }
+        
+        /* Write part is halted without stop, continue with repeated start */
+        status = start_reading(I2C_MODE_REPEAT_START);
+        if (status != I2C_MSTR_NO_ERROR) finish_transaction(I2C_TR_ERROR, status);
+        break;
+        
+    case I2C_ENGINE_READING:
+        status = I2C_MasterStatus();
+        if (status & I2C_MSTAT_XFER_INP) return;
+        if (status & I2C_MSTAT_ERRORS) {
+            finish_transaction(I2C_TR_ERROR, status & I2C_MSTAT_ERRORS);
+            return;
+        }
+        if (status & I2C_MSTAT_RD_CMPLT) finish_transaction(I2C_TR_DONE, I2C_MSTR_NO_ERROR);
+        break;
+    }
+}
+
+/*
+ * @brief  Check if all queued transactions are completed
+ * @return True if the queue is empty
+ */
+uint8 i2c_idle()
+{
+    return engine_state == I2C_ENGINE_IDLE && queue_head == queue_tail;
+}
+
+/*
+ * @brief Prepare transaction reading registers of the slave
+ * @param transaction      Target transaction
  * @param slave_address    Address of target device on the bus
  * @param register_address Address to read from
- * @return                 Integer actual reading
+ * @param len              Number of bytes to read
+ */
+void i2c_prepare_register_read(I2CTransaction* transaction, uint8 slave_address, uint8 register_address, uint8 len)
+{
+    transaction->slave_address = slave_address;
+    transaction->write_data[0] = register_address;
+    transaction->write_len     = 1;
+    transaction->read_len      = len;
+}
+
+/*
+ * @brief Prepare transaction writing a register of the slave
+ * @param transaction      Target transaction
+ * @param slave_address    Address of target device on the bus
+ * @param register_address Address to write to
+ * @param value            Value to write
+ */
+void i2c_prepare_register_write(I2CTransaction* transaction, uint8 slave_address, uint8 register_address, uint8 value)
+{
+    transaction->slave_address = slave_address;
+    transaction->write_data[0] = register_address;
+    transaction->write_data[1] = value;
+    transaction->write_len     = 2;
+    transaction->read_len      = 0;
+}
+
+/*
+ * @brief Read i2c data from the slave. Blocks until the queue executes the read.
+ * @param slave_address    Address of target device on the bus
+ * @param register_address Address to read from
+ * @return                 Integer actual reading, I2C_ERROR on failure
  */
 int16 read_i2c_data(uint8 slave_address, uint8 register_address)
 {
-    uint8 status;
+    I2CTransaction transaction;
     
-    // Send start bit and write bit
-    status = I2C_MasterSendStart(slave_address, I2C_WRITE_XFER_MODE);
-    // Write register address to the bus
-    status = I2C_MasterWriteByte(register_address);
-    // Send restart condition with read bit
-    status = I2C_MasterSendRestart(slave_address, I2C_READ_XFER_MODE);
-    // Check if any errors occured during the operation
-    if (status != I2C_MSTR_NO_ERROR) return I2C_ERROR;
+    i2c_prepare_register_read(&transaction, slave_address, register_address, 1);
+    while (!i2c_submit(&transaction)) i2c_service();
     
-    // Read one byte and send NAK
-    uint8 reading = I2C_MasterReadByte(I2C_NAK_DATA);
-    I2C_MasterSendStop();  // Send stop bit
+    // Transaction lives on the stack, wait for it to complete
+    while (transaction.status == I2C_TR_QUEUED) i2c_service();
+    if (transaction.status != I2C_TR_DONE) return I2C_ERROR;
     
     /* Two's complenment -> integer cast */
-    if (reading & 0x80) reading = -~(reading - 1);
-    
-    return reading;   
+    return (int8)transaction.read_data[0];
 }
 
 /* [] END OF FILE */
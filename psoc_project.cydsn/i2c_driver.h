@@ -6,10 +6,12 @@
  * @date    14.05.2022
  *
  * Simple interface for interacting with I2C bus.
- * This interface only allows to read one byte from specified slave->register
+ * Transactions are queued and executed by the interrupt driven I2C component,
+ * i2c_service() advances the queue from the main loop.
  *
- * The communication template:
- * S | SLAVEADDR | W | REGADDR | ACK | RS | R | DATA | NAK | ST
+ * The communication template of the transaction:
+ * S | SLAVEADDR | W | DATA... | RS | SLAVEADDR | R | DATA... | NAK | ST
+ * Write or read part can be omitted.
  *
  * ========================================
 */
@@ -21,8 +23,36 @@
 #include "project.h"
     
 #define I2C_ERROR 0xc8 // An arbitary I2C error code
+    
+/* Transaction queue configuration */
+#define I2C_QUEUE_LENGTH  4  // Maximum number of transactions waiting for the bus
+#define I2C_MAX_DATA_LEN  8  // Maximum number of bytes written or read by one transaction
+    
+/* Transaction status */
+#define I2C_TR_IDLE    0  // Transaction was never submitted
+#define I2C_TR_QUEUED  1  // Transaction is waiting for the bus or in progress
+#define I2C_TR_DONE    2  // Transaction completed, read data is available
+#define I2C_TR_ERROR   3  // Transaction failed, error holds the reason
+    
+/* Structures and types */
+/* I2C transaction. Write part is sent first, read part follows after repeated start */
+typedef struct i2c_transaction {
+    uint8          slave_address;                 // 7-bit address of the slave
+    uint8          write_data[I2C_MAX_DATA_LEN];  // Data to write
+    uint8          write_len;                     // Number of bytes to write, 0 for read only
+    uint8          read_data[I2C_MAX_DATA_LEN];   // Read data
+    uint8          read_len;                      // Number of bytes to read, 0 for write only
+    volatile uint8 status;                        // Transaction status
+    uint8          error;                         // I2C_MasterStatus() error bits or start error code
+} I2CTransaction;
 
+/* Function declarations */
 void  initialize_i2c();
+uint8 i2c_submit(I2CTransaction* transaction);
+void  i2c_service();
+uint8 i2c_idle();
+void  i2c_prepare_register_read(I2CTransaction* transaction, uint8 slave_address, uint8 register_address, uint8 len);
+void  i2c_prepare_register_write(I2CTransaction* transaction, uint8 slave_address, uint8 register_address, uint8 value);
 int16 read_i2c_data(uint8 slave_address, uint8 register_address);
   
 
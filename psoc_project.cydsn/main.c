@@ -27,22 +27,30 @@
 #include "temperature_soil.h"
 #include "moisture_sensor.h"
 #include "i2c_driver.h"
+#include "temperature_air.h"
 #include "average_filter.h"
 #include "moving_average_filter.h"
+#include "median_filter.h"
+#include "eeprom_writer.h"
+#include "eeprom_layout.h"
 
 #define false             0
 #define true              1
 #define DEF_BUFFER_LENGTH 50     // Maximum length of transmit buffer
-#define ADC_FILTER_LENGTH 100000
+#define ADC_DECIMATION    256    // Decimation ratio of moisture CIC filter, 100 % * 256^3 fits int32
 
-#define TC74_ADDRESS      0x4a   // I2C address of TC74 sensor
-#define TC74_TEMP_REG     0x00   // Temperature register of the sensor
+#define TIMER_ONEWIRE_CLOCK_KHZ 10  // Clock of Timer_OneWire, refer to TopDesign
+#define TIMER_MEASURE_CLOCK_KHZ 10  // Clock of Timer_Measure, refer to TopDesign
+#define TIMER_DEVICECLOCK_CLOCK_KHZ 1  // Clock of Timer_DeviceClock, refer to TopDesign
+#define DEVICE_CLOCK_CHECKPOINT_MIN 60 // Minutes between checkpoints of device time to EEPROM
+#define ONEWIRE_WAIT_MARGIN_MS  50  // Margin added to the worst case conversion time
 
-/* Refer to memory layout for more information */
-#define EEPROM_WRITE_ADDR_MSB   0x00
-#define EEPROM_WRITE_ADDR_LSB   0x01
-#define EEPROM_INFO_ADDR_MSB    0x02
-#define EEPROM_DATA_START_ADDR  0x06
+#define GLITCH_WINDOW_LENGTH    5                              // Median window of outlier rejection, odd
+#define SOIL_TEMP_GLITCH_LIMIT  (2 << SOIL_TEMP_FRACTION_BITS) // Deviation from median, 2 C in 1/16 C
+#define AIR_TEMP_GLITCH_LIMIT   5                              // Deviation from median, C
+
+#define PIPELINE_BENCHMARK      0     // Add B command comparing cycles of fixed point and float temperature path
+#define BENCHMARK_ITERATIONS    100   // Samples processed by each path of the benchmark
 
 #define DEVICE_INFO_PROMPT "PSoC Terrarium V1. Developed by Pavel Arefyev.\r\n"
 
@@ -50,23 +58,47 @@
 // Provides easy read/write programming logic for saving
 typedef struct msr_packed {
     uint32 timestamp;
-    int16  air_temperature;
-    int16  soil_moisture;
-    float  soil_temperature[NUMBER_OF_SOIL_TEMP_SENSORS];
+    int16  air_temperature[NUMBER_OF_AIR_TEMP_SENSORS];
+    int16  soil_moisture[NUMBER_OF_MOISTURE_PROBES];
+    int16  soil_temperature[NUMBER_OF_SOIL_TEMP_SENSORS];  // 1/16 C
 } packed_samples;
 
+/* Samples are logged as records: tag, 16-bit sequence number (MSB first), CRC-8 and packed_samples.
+   Records fill the slots of the data area in a ring, no fixed cell is written on save.
+   CRC covers every other byte of the record, so a record torn by reset in the middle of a multi-row write is not valid */
+#define EEPROM_RECORD_TAG_SAMPLES 0xa5  // Record holds samples
+#define EEPROM_RECORD_TAG_ERASED  0x5a  // Erase mark, older records are not printed
+#define EEPROM_RECORD_CRC_OFFSET  3
+#define EEPROM_RECORD_HEADER_SIZE 4
+#define EEPROM_RECORD_SIZE        (EEPROM_RECORD_HEADER_SIZE + sizeof(packed_samples))
+#define EEPROM_RECORD_SLOTS       ((EEPROM_DATA_END_ADDR - EEPROM_DATA_START_ADDR) / EEPROM_RECORD_SIZE)
+#define EEPROM_RECORD_ADDR(slot)  (EEPROM_DATA_START_ADDR + (slot) * EEPROM_RECORD_SIZE)
+
+/* Moving average filter banks used for data logging, window and sample type are sized per channel group */
+#define MOISTURE_LOG_FILTER_LENGTH  32  // Power of two, result is divided by shifting
+#define AIR_TEMP_LOG_FILTER_LENGTH  32  // Power of two, result is divided by shifting
+#define SOIL_TEMP_LOG_FILTER_LENGTH 32  // Power of two, result is divided by shifting
+DECLARE_MA_FILTER_BANK(MoistureLogBank, moisture_log, uint8, uint16, NUMBER_OF_MOISTURE_PROBES,   MOISTURE_LOG_FILTER_LENGTH);   // 0-100 %
+DECLARE_MA_FILTER_BANK(AirTempLogBank,  air_temp_log, int8,  int16,  NUMBER_OF_AIR_TEMP_SENSORS,  AIR_TEMP_LOG_FILTER_LENGTH);   // TC74 range
+DECLARE_MA_FILTER_BANK(SoilTempLogBank, soil_temp_log, int16, int32, NUMBER_OF_SOIL_TEMP_SENSORS, SOIL_TEMP_LOG_FILTER_LENGTH);  // 1/16 C
+DEFINE_MA_FILTER_BANK(MoistureLogBank, moisture_log, uint8, uint16, NUMBER_OF_MOISTURE_PROBES,   MOISTURE_LOG_FILTER_LENGTH)
+DEFINE_MA_FILTER_BANK(AirTempLogBank,  air_temp_log, int8,  int16,  NUMBER_OF_AIR_TEMP_SENSORS,  AIR_TEMP_LOG_FILTER_LENGTH)
+DEFINE_MA_FILTER_BANK(SoilTempLogBank, soil_temp_log, int16, int32, NUMBER_OF_SOIL_TEMP_SENSORS, SOIL_TEMP_LOG_FILTER_LENGTH)
+
 /* Global variables */
-uint8 static volatile adc_conversion_ready  = false;
 uint8 static volatile ready_to_measure      = false;
 uint8 static volatile ready_to_save         = false;
 uint8 static volatile minute_passed         = false;
 uint8 static volatile ds18b20_sample_ready  = false;
+uint32 static volatile device_time          = 0;  // UNIX timestamp advanced every second by Timer_DeviceClock
+uint16 static log_head_slot     = 0;  // Slot of the next record, found at boot
+uint16 static log_next_sequence = 0;  // Sequence number of the next record
 
 /* Interrupt handlers */
 CY_ISR(isr_ADC_conversion)
 {
     // No need to acknowledge interrupt
-    adc_conversion_ready = true;
+    store_soil_moisture_sample();
 }
 
 // Ready to measure module timer
@@ -87,7 +119,8 @@ CY_ISR(isr_Timer_save)
 CY_ISR(isr_Timer_DeviceClock)
 {
     Timer_DeviceClock_ReadStatusRegister(); // Acknowledge interrupt
-    minute_passed = true;
+    device_time++;
+    if (device_time % 60 == 0) minute_passed = true;
 }
 
 // Oneshot OneWire timer interrupt to track end of conversion
@@ -99,21 +132,37 @@ CY_ISR(isr_OneWire_sample)
 
 /* Function declarations */
 /* EEPROM */
-void   save_samples_to_eeprom(packed_samples samples);
+uint8  save_samples_to_eeprom(packed_samples samples);
 uint16 print_samples_from_eeprom();
 void   init_eeprom_layout();
 void   erase_samples_from_eeprom();
 uint8  set_date(uint day, uint month, uint year);
 uint8  set_time(uint hour, uint minute);
-struct tm get_time_from_eeprom();
+struct tm get_device_time();
+uint32 get_device_time_unix();
+void   set_device_time_unix(uint32 timestamp);
+void   restore_device_time();
 void   save_time_to_eeprom(uint32 timestamp);
-uint32 get_time_from_eeprom_unix();
+uint32 load_time_from_eeprom(uint16* sequence);
+uint8  get_record_tag_from_eeprom(uint16 slot, uint16* sequence);
+uint8  get_record_crc(const uint8* record, uint8 length);
+uint8  write_record_to_eeprom(uint8 tag, const packed_samples* samples);
 /* Menu helpers */
 void   print_sample(packed_samples* sample);
 void   print_current_time();
+void   print_onewire_info();
+void   print_moisture_info();
+void   print_glitch_info(MedianFilter* soil_temp, MedianFilter* air_temp, MedianFilter* actuator);
+void   print_eeprom_info(uint8 record_row_writes);
+void   print_moisture_calib();
+uint8  handle_calib_command(const char* args);
 void   print_help();
+#if PIPELINE_BENCHMARK
+void   print_pipeline_benchmark();
+#endif
 /* Other */
 void   Timer_OneWire_Restart();
+void   Timer_OneWire_SetWaitTime(uint16 wait_ms);
 
 /* ==================== */
 /*  MAIN FUNCTION BODY  */
@@ -130,6 +179,8 @@ int main()
     Clock_1MHz_Start();
     Timer_Measure_Start();
     Timer_Save_Start();
+    Timer_DeviceClock_WritePeriod(1000 * TIMER_DEVICECLOCK_CLOCK_KHZ - 1);  // Device clock ticks every second
+    Timer_DeviceClock_WriteCounter(1000 * TIMER_DEVICECLOCK_CLOCK_KHZ - 1);
     Timer_DeviceClock_Start();
     
     /* Enable interrupt sources */
@@ -143,112 +194,248 @@ int main()
     inititialize_hatch();
     initialize_soil_moisture_sensor();
     initialize_soil_temp_sensors();
+    Timer_OneWire_SetWaitTime(get_soil_temp_max_conversion_time() + ONEWIRE_WAIT_MARGIN_MS);
     initialize_i2c();
+    initialize_air_temp_sensors();
     init_eeprom_layout();
+    restore_device_time();
 
     /* main Variable block */
     char receive_buffer[DEF_BUFFER_LENGTH];
     uint8 rx_index = 0;  // Index that points to next write index in rx buffer
     uint8 input;         // User input
     
-    int air_temperature = 0;
-    int soil_moisture   = 0;
-    uint8 ds18b20_ready_to_convert = true;  // Flag indicating whether conversion should be started
-    float onewire_samples[NUMBER_OF_SOIL_TEMP_SENSORS] = { 0 };
+    int16 air_temperature = 0;
+    uint8 ds18b20_ready_to_convert = true;   // Flag indicating whether conversion should be started
+    uint8 ds18b20_converting       = false;  // Flag indicating whether sensors are converting
+    uint8 ds18b20_reading_queued   = false;  // Flag indicating whether readings wait for OneWire engine
+    uint8 minutes_since_rescan     = 0;      // Minutes passed since the last OneWire bus rescan
+    uint8 minutes_since_checkpoint = 0;      // Minutes passed since device time was saved to EEPROM
+    uint8 tc74_reading_queued      = false;  // Flag indicating whether air temperature readings wait for I2C
+#if AIR_TEMP_STANDBY
+    uint8 tc74_awake               = false;  // Flag indicating whether air temperature sensors were woken for the tick
+#endif
+    uint8 tc74_lost                = false;  // Flag indicating whether all air temperature readings have expired
+    int16 onewire_samples[NUMBER_OF_SOIL_TEMP_SENSORS] = { 0 };  // 1/16 C
+    uint8 onewire_samples_valid[NUMBER_OF_SOIL_TEMP_SENSORS] = { 0 };  // Failed readings are kept out of filters
+    uint8 record_row_writes = 0;  // EEPROM row writes done by the last saved record
     packed_samples measurements;
 
     /* Initialize filters as empty */
-    AverageFilter       adc_moist_filter    = { ADC_FILTER_LENGTH, 0, 0 };
-    /* Moving average filters are used for data logging */
-    MovingAverageFilter soil_moisute_filter = { {0}, 0, 0 };
-    MovingAverageFilter air_temp_filter     = { {0}, 0, 0 };
-    MovingAverageFilter soil_temperature_filter[NUMBER_OF_SOIL_TEMP_SENSORS] = { 
-        { {0}, 0, 0 }, { {0}, 0, 0 }
-    };
+    /* Median filters reject glitches before they reach averages and actuators */
+    MedianFilter soil_temp_glitch_filter[NUMBER_OF_SOIL_TEMP_SENSORS];
+    MedianFilter air_temp_glitch_filter[NUMBER_OF_AIR_TEMP_SENSORS];
+    MedianFilter actuator_glitch_filter;
+    for (uint8 i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
+        init_median_filter(&soil_temp_glitch_filter[i], GLITCH_WINDOW_LENGTH, SOIL_TEMP_GLITCH_LIMIT);
+    }
+    for (uint8 i = 0; i < NUMBER_OF_AIR_TEMP_SENSORS; i++) {
+        init_median_filter(&air_temp_glitch_filter[i], GLITCH_WINDOW_LENGTH, AIR_TEMP_GLITCH_LIMIT);
+    }
+    init_median_filter(&actuator_glitch_filter, GLITCH_WINDOW_LENGTH, AIR_TEMP_GLITCH_LIMIT);
+    CicFilter           adc_moist_filter[NUMBER_OF_MOISTURE_PROBES];
+    for (uint8 i = 0; i < NUMBER_OF_MOISTURE_PROBES; i++) {
+        init_cic_filter(&adc_moist_filter[i], ADC_DECIMATION);
+    }
+    /* Moving average filter banks are used for data logging, all channels of a bank are updated at once */
+    MoistureLogBank     soil_moisute_bank;
+    AirTempLogBank      air_temp_bank;
+    SoilTempLogBank     soil_temperature_bank;
+    reset_moisture_log_bank(&soil_moisute_bank);
+    reset_air_temp_log_bank(&air_temp_bank);
+    reset_soil_temp_log_bank(&soil_temperature_bank);
     
     print_help();  // Print user help information 
     while (true) {
         /* HANDLE INTERRUPTS */    
         
-        /* ADC conversion for soil moisture sensor ready */
-        if (adc_conversion_ready) {
-            int16 adc_sample = get_soil_moisture();
-            add_sample_to_filter(&adc_moist_filter, adc_sample);
-            
-            adc_conversion_ready = false;
+        /* ADC conversions for soil moisture probes buffered by the interrupt */
+        for (uint8 probe = 0; probe < NUMBER_OF_MOISTURE_PROBES; probe++) {
+            int   moisture_block[MOISTURE_BLOCK_LENGTH];
+            uint8 block_len;
+            while ((block_len = read_soil_moisture_block(probe, moisture_block, MOISTURE_BLOCK_LENGTH))) {
+                for (uint8 i = 0; i < block_len; i++) {
+                    add_sample_to_cic_filter(&adc_moist_filter[probe], moisture_block[i]);
+                }
+            }
         }
         
         /* Initiate conversion on DS18b20 sensors */
         if (ds18b20_ready_to_convert) {
-            /* Command conversion for all sesnors */
-            for (uint8 i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
-                start_conversion_soil_temp_sensor(i);
-            }        
+            /* Broadcast conversion to all sesnors, resolutions set since the last cycle are written first */
+            plan_soil_temp_conversion();
+            Timer_OneWire_SetWaitTime(get_soil_temp_max_conversion_time() + ONEWIRE_WAIT_MARGIN_MS);
             /* Run one shot timer to wait for the conversion */
             Timer_OneWire_Restart();
             Timer_OneWire_Start();
             
             ds18b20_ready_to_convert = false;
+            ds18b20_converting       = true;
+        }
+        
+#if SOIL_TEMP_ADAPTIVE_CONVERSION
+        /* Do not wait for the timer if all sensors have finished the conversion */
+        if (ds18b20_converting && soil_temp_conversion_done()) {
+            ds18b20_sample_ready = true;
         }
+#endif
         
-        /* Collect raw samples from DS18b20 sensors */
+        /* Plan reading of raw samples from DS18b20 sensors */
         if (ds18b20_sample_ready) {
+            /* Timer is a timeout in adaptive mode, ignore it once samples are taken */
+            if (ds18b20_converting) {
+                Timer_OneWire_Stop();
+                plan_soil_temp_readout();
+                
+                ds18b20_converting     = false;
+                ds18b20_reading_queued = true;
+            }
+            
+            ds18b20_sample_ready = false;
+        }
+        
+        /* Collect raw samples once the OneWire engine is done */
+        if (ds18b20_reading_queued && !soil_temp_sensors_busy()) {
             /* Get samples from all sensors */
-            for (uint8 i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
-                onewire_samples[i] = get_soil_temperature(i);
+            for (uint8 i = 0; i < get_soil_temp_sensor_count(); i++) {
+                onewire_samples_valid[i] = get_queued_soil_temperature(i, &onewire_samples[i]);
             }
             
             /* Update flags to trigger next conversion */
-            ds18b20_sample_ready     = false;
+            ds18b20_reading_queued   = false;
             ds18b20_ready_to_convert = true;
         }
         
+        /* Advance background rescan of OneWire buses between the cycles */
+        if (!ds18b20_converting && !ds18b20_reading_queued && soil_temp_rescan_step()) {
+            /* Indexes of the sensors have changed, start filtering from scratch */
+            reset_soil_temp_log_bank(&soil_temperature_bank);
+            for (uint8 i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
+                init_median_filter(&soil_temp_glitch_filter[i], GLITCH_WINDOW_LENGTH, SOIL_TEMP_GLITCH_LIMIT);
+                onewire_samples_valid[i] = false;
+            }
+            Timer_OneWire_SetWaitTime(get_soil_temp_max_conversion_time() + ONEWIRE_WAIT_MARGIN_MS);
+            UART_PutString("Soil temperature sensors have changed.\r\n");
+        }
+        
+#if AIR_TEMP_STANDBY
+        /* Wake air temperature sensors, so that fresh conversion is ready at the measure tick */
+        if (!tc74_awake && Timer_Measure_ReadCounter() <= (uint32)AIR_TEMP_WAKE_TIME_MS * TIMER_MEASURE_CLOCK_KHZ) {
+            wake_air_temp_sensors();
+            tc74_awake = true;
+        }
+#endif
+        
         /* Ready to measure, update sensor values */
         if (ready_to_measure) {
-            // Update soil moisture and save to moving average filter
-            soil_moisture = get_filtered_result(&adc_moist_filter);
-            add_sample_to_MA_filter(&soil_moisute_filter, soil_moisture);
+            // Update soil moisture of all probes and save to moving average filter bank
+            uint8 moisture_samples[NUMBER_OF_MOISTURE_PROBES];
+            for (uint8 i = 0; i < NUMBER_OF_MOISTURE_PROBES; i++) {
+                moisture_samples[i] = get_cic_filtered_result(&adc_moist_filter[i]);
+            }
+            add_samples_to_moisture_log_bank(&soil_moisute_bank, moisture_samples, (1ul << NUMBER_OF_MOISTURE_PROBES) - 1);
             
-            // Update air temperature and save to moving average filter
-            air_temperature = read_i2c_data(TC74_ADDRESS, TC74_TEMP_REG);
-            add_sample_to_MA_filter(&air_temp_filter, air_temperature);
+            // Post air temperature reads, results are handled once the transfers are done
+            plan_air_temp_readout();
+            tc74_reading_queued = true;
+#if AIR_TEMP_STANDBY
+            tc74_awake          = false;  // Sensors return to standby after the readout
+#endif
             
-            // Save soild temperature to moving average filter for all sensors
-            for (uint8 i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
-                add_sample_to_MA_filter(&soil_temperature_filter[i], onewire_samples[i]);
+            // Save soild temperature to moving average filter bank for all sensors, glitches are replaced by median
+            int16  soil_temp_samples[NUMBER_OF_SOIL_TEMP_SENSORS];
+            uint32 soil_temp_valid = 0;
+            for (uint8 i = 0; i < get_soil_temp_sensor_count(); i++) {
+                int32 accepted;
+                if (!onewire_samples_valid[i]) continue;
+                add_sample_to_median_filter(&soil_temp_glitch_filter[i], onewire_samples[i], &accepted);
+                soil_temp_samples[i] = accepted;
+                soil_temp_valid |= 1ul << i;
             }
-            
-            /* Adjust actuators accoring to sample measurements */
-            adjust_hatch(air_temperature);
-            adjust_heater(air_temperature);
+            add_samples_to_soil_temp_log_bank(&soil_temperature_bank, soil_temp_samples, soil_temp_valid);
             
             ready_to_measure = false;
         }
         
+        /* Advance I2C transfers, bytes are moved by the I2C interrupt */
+        i2c_service();
+        
+        /* Air temperature reads completed */
+        if (tc74_reading_queued && !air_temp_sensors_busy()) {
+            // Save air temperature to moving average filter bank for all sensors, failed reads are skipped
+            int8   air_temp_samples[NUMBER_OF_AIR_TEMP_SENSORS];
+            uint32 air_temp_valid = 0;
+            for (uint8 i = 0; i < get_air_temp_sensor_count(); i++) {
+                int16 sample;
+                int32 accepted;
+                if (!get_air_temperature(i, &sample)) continue;
+                add_sample_to_median_filter(&air_temp_glitch_filter[i], sample, &accepted);
+                air_temp_samples[i] = accepted;
+                air_temp_valid |= 1ul << i;
+            }
+            add_samples_to_air_temp_log_bank(&air_temp_bank, air_temp_samples, air_temp_valid);
+            
+            /* Adjust actuators accoring to aggregate of the sensors, keep their state if all readings expired */
+            if (get_aggregate_air_temperature(&air_temperature)) {
+                // Single glitch must not move the hatch
+                int32 accepted;
+                add_sample_to_median_filter(&actuator_glitch_filter, air_temperature, &accepted);
+                air_temperature = accepted;
+                adjust_hatch(air_temperature);
+                adjust_heater(air_temperature);
+                tc74_lost = false;
+            }
+            else if (!tc74_lost && get_air_temp_sensor_count()) {
+                UART_PutString("Air temperature sensors are not answering.\r\n");
+                tc74_lost = true;
+            }
+            
+            tc74_reading_queued = false;
+        }
+        
         /* Ready to save, write the measurement to next EEPROM block */
         if (ready_to_save) {
             /* Prepare timestamp */
-            measurements.timestamp = get_time_from_eeprom_unix();
+            measurements.timestamp = get_device_time_unix();
+            
+            /* Filter collected samples using box average, all channels of a bank in one call */
+            // Slots of missing sensors and sensors without valid samples are saved as zero
+            int8  air_temp_results[NUMBER_OF_AIR_TEMP_SENSORS];
+            uint8 moisture_results[NUMBER_OF_MOISTURE_PROBES];
+            int16 soil_temp_results[NUMBER_OF_SOIL_TEMP_SENSORS];
+            get_air_temp_log_bank_results(&air_temp_bank, air_temp_results);
+            get_moisture_log_bank_results(&soil_moisute_bank, moisture_results);
+            get_soil_temp_log_bank_results(&soil_temperature_bank, soil_temp_results);
             
-            /* Filter collected samples using box average */
-            measurements.air_temperature = get_MA_filtered_result(&air_temp_filter);
-            measurements.soil_moisture = get_MA_filtered_result(&soil_moisute_filter);
+            for (int i = 0; i < NUMBER_OF_AIR_TEMP_SENSORS; i++) {
+                measurements.air_temperature[i] = air_temp_results[i];
+            }
+            for (int i = 0; i < NUMBER_OF_MOISTURE_PROBES; i++) {
+                measurements.soil_moisture[i] = moisture_results[i];
+            }
             for (int i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
-                measurements.soil_temperature[i] = get_MA_filtered_result(&soil_temperature_filter[i]);   
+                measurements.soil_temperature[i] = soil_temp_results[i];
             }
             
             /* Save samples to EEPROM */
-            save_samples_to_eeprom(measurements);
+            record_row_writes = save_samples_to_eeprom(measurements);
             
             ready_to_save = false;
         }
         
-        /* Minute passed, adjust clock and save current time to EEPROM */
+        /* Minute passed, checkpoint current time to EEPROM once in a while */
         if (minute_passed) {
-            // Adjust timestamp by 60 seconds
-            uint32 current_time = get_time_from_eeprom_unix();
-            current_time += 60;
-            save_time_to_eeprom(current_time);
+            // Device time is kept in RAM, checkpoint lets it survive a reset
+            if (++minutes_since_checkpoint >= DEVICE_CLOCK_CHECKPOINT_MIN) {
+                save_time_to_eeprom(get_device_time_unix());
+                minutes_since_checkpoint = 0;
+            }
+            
+            // Detect added or removed soil temperature sensors
+            if (++minutes_since_rescan >= SOIL_TEMP_RESCAN_PERIOD_MIN) {
+                start_soil_temp_rescan();
+                minutes_since_rescan = 0;
+            }
             
             minute_passed = false;
         }
@@ -275,7 +462,7 @@ int main()
             rx_index = 0;
             
             /* Parse received command */
-            uint day, month, year, hour, minute;
+            uint day, month, year, hour, minute, sensor, resolution;
             if (strcmp(receive_buffer, "?") == 0) {
                 UART_PutString(DEVICE_INFO_PROMPT);  
             }
@@ -296,6 +483,34 @@ int main()
             else if (strcmp(receive_buffer, "D") == 0) {
                 print_current_time();
             }
+            else if (strcmp(receive_buffer, "O") == 0) {
+                print_onewire_info();
+            }
+            else if (strcmp(receive_buffer, "M") == 0) {
+                print_moisture_info();
+            }
+#if PIPELINE_BENCHMARK
+            else if (strcmp(receive_buffer, "B") == 0) {
+                print_pipeline_benchmark();
+            }
+#endif
+            else if (strcmp(receive_buffer, "E") == 0) {
+                print_eeprom_info(record_row_writes);
+            }
+            else if (strcmp(receive_buffer, "G") == 0) {
+                print_glitch_info(soil_temp_glitch_filter, air_temp_glitch_filter, &actuator_glitch_filter);
+            }
+            else if (strncmp(receive_buffer, "CALIB", 5) == 0) {
+                uint8 success = handle_calib_command(&receive_buffer[5]);
+                if (!success) UART_PutString("Invalid calibration.\r\n");
+            }
+            else if (sscanf(receive_buffer, "R %u %u", &sensor, &resolution) == 2) {
+                // Values are narrowed to uint8, check them first so that "R 256 9" is not taken as sensor 0
+                uint8 success = sensor < get_soil_temp_sensor_count() &&
+                                resolution >= SOIL_TEMP_RESOLUTION_MIN && resolution <= SOIL_TEMP_RESOLUTION_MAX &&
+                                set_soil_temp_resolution(sensor, resolution);
+                success ? UART_PutString("New resolution scheduled.\r\n") : UART_PutString("Invalid values.\r\n");
+            }
             
             print_help(); 
         }
@@ -320,13 +535,13 @@ uint8 set_date(uint day, uint month, uint year)
     if (month > 12 || month < 1)    return false;
     if (day > 31 || day < 1)        return false;
     
-    struct tm current_time = get_time_from_eeprom();
+    struct tm current_time = get_device_time();
     current_time.tm_year = year - 1900;
     current_time.tm_mon = month - 1;
     current_time.tm_mday = day;
     
     uint32 timestamp = (uint32)mktime(&current_time);
-    save_time_to_eeprom(timestamp);
+    set_device_time_unix(timestamp);
     
     return true;
 }
@@ -343,12 +558,13 @@ uint8 set_time(uint hour, uint minute)
     if (minute > 59) return false;
     if (hour > 23)   return false;
 
-    struct tm current_time = get_time_from_eeprom();
+    struct tm current_time = get_device_time();
     current_time.tm_hour = hour;
     current_time.tm_min = minute;
+    current_time.tm_sec = 0;
     
     uint32 timestamp = (uint32)mktime(&current_time);
-    save_time_to_eeprom(timestamp);
+    set_device_time_unix(timestamp);
     
     return true;
 }
@@ -359,110 +575,248 @@ uint8 set_time(uint hour, uint minute)
  */
 void print_current_time()
 {
-    struct tm current_time = get_time_from_eeprom();
+    struct tm current_time = get_device_time();
     char transmit_buffer[DEF_BUFFER_LENGTH * 2];
     
     sprintf(
         transmit_buffer,
-        "Current time: %02d/%02d/%d %02d:%02d\r\n",
+        "Current time: %02d/%02d/%d %02d:%02d:%02d\r\n",
         current_time.tm_mday, current_time.tm_mon + 1, current_time.tm_year + 1900,
-        current_time.tm_hour, current_time.tm_min
+        current_time.tm_hour, current_time.tm_min, current_time.tm_sec
     );
     
     UART_PutString(transmit_buffer);
 }
 
 /*
- * @brief  Get current device time information from eeprom
+ * @brief  Get current device time information
  * @return TM structure containing current device time information
  */
-struct tm get_time_from_eeprom()
+struct tm get_device_time()
 {
     /* Obtain current timestamp */
-    time_t timestamp = (time_t)get_time_from_eeprom_unix();
-    struct tm device_time;
-    (void)localtime_r(&timestamp, &device_time);  // Breakdown unix timestamp
+    time_t timestamp = (time_t)get_device_time_unix();
+    struct tm current_time;
+    (void)localtime_r(&timestamp, &current_time);  // Breakdown unix timestamp
     
-    return device_time;
+    return current_time;
 }
 
 /*
- * @brief Get current device time information from eeprom
- * @param Unix timestamp
+ * @brief  Get current device time, kept in RAM
+ * @return Unix timestamp
  */
-uint32 get_time_from_eeprom_unix()
+uint32 get_device_time_unix()
 {
-    /* Obtain current timestamp */
-    uint32 timestamp = ((EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB)     << 24)  | 
-                        (EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 1) << 16) |
-                        (EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 2) << 8 ) |
-                        (EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 3))); 
+    return device_time;  // Single aligned read, no need to stop the clock interrupt
+}
+
+/*
+ * @brief Set device time and checkpoint it to EEPROM at once
+ * @param timestamp New unix timestamp
+ */
+void set_device_time_unix(uint32 timestamp)
+{
+    device_time = timestamp;
+    save_time_to_eeprom(timestamp);
+}
+
+/*
+ * @brief Restore device time at boot from the last checkpoint or the newest record, whichever was saved later.
+ * Order is decided by sequence numbers, not by the times, so time set back with D/T survives a reset.
+ */
+void restore_device_time()
+{
+    uint16 checkpoint_sequence;
+    uint32 timestamp = load_time_from_eeprom(&checkpoint_sequence);
+    uint16 slot = log_head_slot == 0 ? EEPROM_RECORD_SLOTS - 1 : log_head_slot - 1;
+    uint16 sequence;
+    
+    /* Checkpoint holds sequence number of the next record when it was saved,
+       record with that or later sequence was saved after the checkpoint. Timestamp is the first member of packed_samples */
+    if (get_record_tag_from_eeprom(slot, &sequence) == EEPROM_RECORD_TAG_SAMPLES &&
+        sequence == (uint16)(log_next_sequence - 1) &&
+        (int16)(sequence - checkpoint_sequence) >= 0) {
+        uint8 in_buffer[sizeof(uint32)];
+        for (uint8 i = 0; i < sizeof(in_buffer); i++) {
+            in_buffer[i] = EEPROM_ReadByte(EEPROM_RECORD_ADDR(slot) + EEPROM_RECORD_HEADER_SIZE + i);
+        }
+        memcpy(&timestamp, in_buffer, sizeof(timestamp));
+    }
+    
+    device_time = timestamp;
+}
+
+/*
+ * @brief  Load time checkpoint from EEPROM
+ * @param  sequence Sequence number of the next record when the checkpoint was saved
+ * @return          Unix timestamp
+ */
+uint32 load_time_from_eeprom(uint16* sequence)
+{
+    /* Obtain saved timestamp */
+    uint32 timestamp = ((uint32)EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB)     << 24) | 
+                       ((uint32)EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 1) << 16) |
+                       ((uint32)EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 2) << 8 ) |
+                       ((uint32)EEPROM_ReadByte(EEPROM_INFO_ADDR_MSB + 3)); 
+    
+    *sequence = (EEPROM_ReadByte(EEPROM_INFO_SEQUENCE_ADDR_MSB) << 8) | EEPROM_ReadByte(EEPROM_INFO_SEQUENCE_ADDR_MSB + 1);
     
     return timestamp;
 }
 
 /*
- * @brief Save time to EEPROM
+ * @brief Save time checkpoint to EEPROM together with sequence number of the next record
  * @param Unix timestamp to be saved
  */
 void save_time_to_eeprom(uint32 timestamp)
 {
+    uint8 out_buffer[6];
     for (int i = 3; i >= 0; i--) {
-        EEPROM_WriteByte((timestamp >> (8 * i)), EEPROM_INFO_ADDR_MSB + (3 - i));   
+        out_buffer[3 - i] = timestamp >> (8 * i);
     }
+    out_buffer[4] = log_next_sequence >> 8;
+    out_buffer[5] = log_next_sequence;
+    
+    /* All 6 bytes are in one row, timestamp and sequence are updated together */
+    write_eeprom_block(EEPROM_INFO_ADDR_MSB, out_buffer, sizeof(out_buffer), NULL);
 }
 
 /*
- * @brief Initialize EEPROM layout.
- * This will check the validity of layout and fix if required.
+ * @brief  Get header of the record slot from EEPROM
+ * @param  slot     Index of the slot
+ * @param  sequence Sequence number of the record
+ * @return          Tag of the record, 0 if the slot holds no complete record
  */
-void init_eeprom_layout()
+uint8 get_record_tag_from_eeprom(uint16 slot, uint16* sequence)
 {
-    /* Obtain next writing address */
-    uint16 address = (EEPROM_ReadByte(EEPROM_WRITE_ADDR_MSB) << 8) | EEPROM_ReadByte(EEPROM_WRITE_ADDR_LSB);
+    uint8  in_buffer[EEPROM_RECORD_SIZE];
+    uint16 address = EEPROM_RECORD_ADDR(slot);
+    uint8  tag     = EEPROM_ReadByte(address);
+    uint8  length  = EEPROM_RECORD_HEADER_SIZE;
+    
+    if (tag != EEPROM_RECORD_TAG_SAMPLES && tag != EEPROM_RECORD_TAG_ERASED) return 0;
+    if (tag == EEPROM_RECORD_TAG_SAMPLES) length = EEPROM_RECORD_SIZE;
     
-    /* Write address validity check */
-    if (address < EEPROM_DATA_START_ADDR) {
-        address = EEPROM_DATA_START_ADDR;
-        EEPROM_WriteByte(address >> 8 , EEPROM_WRITE_ADDR_MSB);
-        EEPROM_WriteByte(address      , EEPROM_WRITE_ADDR_LSB);
+    /* Torn write leaves bytes of the previous record in some rows */
+    for (uint8 i = 0; i < length; i++) {
+        in_buffer[i] = EEPROM_ReadByte(address + i);
     }
+    if (get_record_crc(in_buffer, length) != in_buffer[EEPROM_RECORD_CRC_OFFSET]) return 0;
+    
+    *sequence = (in_buffer[1] << 8) | in_buffer[2];
+    
+    return tag;
 }
 
 /*
- * @brief Erase all the samples stored in EEPROM
+ * @brief  Compute CRC-8 (Dallas/Maxim polynomial) of the record, CRC byte itself is skipped
+ * @param  record Bytes of the record
+ * @param  length Length of the record
+ * @return        CRC of the record
  */
-void erase_samples_from_eeprom()
+uint8 get_record_crc(const uint8* record, uint8 length)
+{
+    uint8 crc = 0;
+    
+    for (uint8 i = 0; i < length; i++) {
+        if (i == EEPROM_RECORD_CRC_OFFSET) continue;
+        crc ^= record[i];
+        for (uint8 bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x01) ? (crc >> 1) ^ 0x8c : crc >> 1;
+        }
+    }
+    
+    return crc;
+}
+
+/*
+ * @brief  Write record to the head slot and advance the head
+ * @param  tag     Tag of the record
+ * @param  samples Samples of the record, NULL for the erase mark
+ * @return         Number of row writes done
+ */
+uint8 write_record_to_eeprom(uint8 tag, const packed_samples* samples)
 {
-    /* Erasing samples from eeprom just means resetting writing index */
-    uint16 address = EEPROM_DATA_START_ADDR;
-    EEPROM_WriteByte(address >> 8 , EEPROM_WRITE_ADDR_MSB);
-    EEPROM_WriteByte(address      , EEPROM_WRITE_ADDR_LSB);
+    uint8 out_buffer[EEPROM_RECORD_SIZE];
+    uint8 length = EEPROM_RECORD_HEADER_SIZE;
+    uint8 row_writes;
+    
+    out_buffer[0] = tag;
+    out_buffer[1] = log_next_sequence >> 8;
+    out_buffer[2] = log_next_sequence;
+    if (samples != NULL) {
+        memcpy(&out_buffer[EEPROM_RECORD_HEADER_SIZE], samples, sizeof(packed_samples));
+        length += sizeof(packed_samples);
+    }
+    out_buffer[EEPROM_RECORD_CRC_OFFSET] = get_record_crc(out_buffer, length);
+    
+    /* Every row the record spans is written once */
+    write_eeprom_block(EEPROM_RECORD_ADDR(log_head_slot), out_buffer, length, &row_writes);
+    
+    log_next_sequence++;
+    if (++log_head_slot == EEPROM_RECORD_SLOTS) log_head_slot = 0;
+    
+    return row_writes;
 }
 
 /*
- * @brief Save new sample to EERPOM
- * @param samples New samples to save
+ * @brief Initialize EEPROM layout.
+ * Head of the record log is found by binary search over the sequence numbers.
  */
-void save_samples_to_eeprom(packed_samples samples)
+void init_eeprom_layout()
 {
-    /* Represent structure as byte array */
-    uint8 out_buffer[sizeof(packed_samples)];
-    memcpy(out_buffer, &samples, sizeof(packed_samples));
+    uint16 anchor = 0;
+    uint16 first_sequence;
     
-    /* Obtain next writing address */
-    uint16 address = (EEPROM_ReadByte(EEPROM_WRITE_ADDR_MSB) << 8) | EEPROM_ReadByte(EEPROM_WRITE_ADDR_LSB);
-    /* If no space left, reset the address */
-    if (address + sizeof(packed_samples) >= CYDEV_EE_SIZE) address = EEPROM_DATA_START_ADDR;
+    log_head_slot     = 0;
+    log_next_sequence = 0;
     
-    /* Save previously obtained byte array */
-    for (uint8 i = 0; i < (uint8)sizeof(packed_samples); i++) {
-        EEPROM_WriteByte(out_buffer[i], address++);
+    /* Invalid first slot was torn by reset while being rewritten, the head is there and
+       the rest of the ring holds the previous lap. Empty log if the next slot is not valid either */
+    if (!get_record_tag_from_eeprom(anchor, &first_sequence)) {
+        anchor = 1;
+        if (!get_record_tag_from_eeprom(anchor, &first_sequence)) return;
     }
     
-    /* Update next writing address */
-    EEPROM_WriteByte(address >> 8 , EEPROM_WRITE_ADDR_MSB);
-    EEPROM_WriteByte(address      , EEPROM_WRITE_ADDR_LSB);
+    /* Slots before the head hold sequence numbers counting up from the anchor,
+       the head is the first slot breaking the count (empty or left from the previous lap) */
+    uint16 low  = anchor + 1;
+    uint16 high = EEPROM_RECORD_SLOTS;
+    while (low < high) {
+        uint16 middle = (low + high) / 2;
+        uint16 sequence;
+        if (get_record_tag_from_eeprom(middle, &sequence) && (uint16)(sequence - first_sequence) == middle - anchor) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    /* Continue counting from the newest record */
+    get_record_tag_from_eeprom(low - 1, &log_next_sequence);
+    log_next_sequence++;
+    log_head_slot = low % EEPROM_RECORD_SLOTS;
+}
+
+/*
+ * @brief Erase all the samples stored in EEPROM
+ */
+void erase_samples_from_eeprom()
+{
+    /* Erasing samples from eeprom just means writing erase mark, older records are not printed */
+    write_record_to_eeprom(EEPROM_RECORD_TAG_ERASED, NULL);
+}
+
+/*
+ * @brief  Save new sample to EERPOM
+ * @param  samples New samples to save
+ * @return         Number of row writes done
+ */
+uint8 save_samples_to_eeprom(packed_samples samples)
+{
+    /* Oldest record is overwritten once the log is full */
+    return write_record_to_eeprom(EEPROM_RECORD_TAG_SAMPLES, &samples);
 }
 
 /*
@@ -470,25 +824,34 @@ void save_samples_to_eeprom(packed_samples samples)
  */
 uint16 print_samples_from_eeprom()
 {
-    /* Obtain next writing address */
-    uint16 last_address = (EEPROM_ReadByte(EEPROM_WRITE_ADDR_MSB) << 8) | EEPROM_ReadByte(EEPROM_WRITE_ADDR_LSB);
     uint16 num_samples_read = 0;
+    uint16 slot = log_head_slot;
+    uint16 sequence;
     
-    /* Print all the samples */
-    uint16 i = EEPROM_DATA_START_ADDR;
-    while (i < last_address) {
+    /* Walk back from the newest record to the erase mark or the oldest record */
+    while (num_samples_read < EEPROM_RECORD_SLOTS) {
+        slot = slot == 0 ? EEPROM_RECORD_SLOTS - 1 : slot - 1;
+        if (get_record_tag_from_eeprom(slot, &sequence) != EEPROM_RECORD_TAG_SAMPLES) break;
+        if (sequence != (uint16)(log_next_sequence - 1 - num_samples_read)) break;
+        num_samples_read++;
+    }
+    
+    /* Print all the samples from the oldest one */
+    slot = (log_head_slot + EEPROM_RECORD_SLOTS - num_samples_read) % EEPROM_RECORD_SLOTS;
+    for (uint16 i = 0; i < num_samples_read; i++) {
         uint8 in_buffer[sizeof(packed_samples)];
+        uint16 address = EEPROM_RECORD_ADDR(slot) + EEPROM_RECORD_HEADER_SIZE;
         
         /* Read single sample from EEPROM */
         for (uint8 j = 0; j < (uint8)sizeof(packed_samples); j++) {
-            in_buffer[j] = EEPROM_ReadByte(i++);
+            in_buffer[j] = EEPROM_ReadByte(address++);
         }
         
         /* Print newly read sample */
         packed_samples* sample = (packed_samples*)in_buffer;
         print_sample(sample);
         
-        num_samples_read++;  // Increment number of read samples
+        if (++slot == EEPROM_RECORD_SLOTS) slot = 0;
     }
     
     return num_samples_read;
@@ -500,7 +863,7 @@ uint16 print_samples_from_eeprom()
  */
 void print_sample(packed_samples* sample)
 {
-    char transmit_buffer[DEF_BUFFER_LENGTH * 4];
+    char transmit_buffer[DEF_BUFFER_LENGTH * 8];
     
     struct tm dtime;
     time_t ts = (time_t)(sample->timestamp);
@@ -510,22 +873,43 @@ void print_sample(packed_samples* sample)
     int idx = sprintf(
         transmit_buffer,
         "{\r\n"
-        "\tDate:     %02d.%02d.%d %02d:%02d\r\n"
-        "\tTair:     %d dC\r\n"
-        "\tHsoil:    %d %%\r\n",
+        "\tDate:     %02d.%02d.%d %02d:%02d\r\n",
         dtime.tm_mday, dtime.tm_mon + 1, dtime.tm_year + 1900,
-        dtime.tm_hour, dtime.tm_min,
-        sample->air_temperature,
-        sample->soil_moisture
+        dtime.tm_hour, dtime.tm_min
     );
     
+    /* Soil moisture for each probe */
+    for (int i = 0; i < NUMBER_OF_MOISTURE_PROBES; i++) {
+        idx += sprintf(
+            &transmit_buffer[idx],
+            "\tHsoil[%d]: %d %%\r\n",
+            i,
+            sample->soil_moisture[i]
+        );
+    }
+    
+    /* Air temperature for each sensor */
+    for (int i = 0; i < NUMBER_OF_AIR_TEMP_SENSORS; i++) {
+        idx += sprintf(
+            &transmit_buffer[idx],
+            "\tTair[%d]:  %d dC\r\n",
+            i,
+            sample->air_temperature[i]
+        );
+    }
+    
     /* Construct second part of string that includes soil temperature for each sensor */
     for (int i = 0; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
+        // Fixed point is formatted by integer parts, 1/16 C is 0.0625 C
+        int16  temperature = sample->soil_temperature[i];
+        uint16 magnitude   = temperature < 0 ? -temperature : temperature;
         idx += sprintf(
             &transmit_buffer[idx],
-            "\tTsoil[%d]: %.4f dC\r\n",
+            "\tTsoil[%d]: %s%u.%04u dC\r\n",
             i,
-            sample->soil_temperature[i]
+            temperature < 0 ? "-" : "",
+            magnitude >> SOIL_TEMP_FRACTION_BITS,
+            (magnitude & ((1 << SOIL_TEMP_FRACTION_BITS) - 1)) * 625
         );
     }
     
@@ -535,6 +919,233 @@ void print_sample(packed_samples* sample)
     UART_PutString(transmit_buffer);
 }
 
+/*
+ * @brief Print OneWire bus diagnostics
+ */
+void print_onewire_info()
+{
+    char transmit_buffer[DEF_BUFFER_LENGTH * 2];
+    
+    sprintf(
+        transmit_buffer,
+        "Sensors found:      %u\r\n"
+        "Bus time per cycle: %lu us\r\n"
+        "Conversion time:    %u ms\r\n"
+        "Sensors read:       %u\r\n",
+        get_soil_temp_sensor_count(),
+        (unsigned long)get_soil_temp_cycle_bus_time(),
+        get_soil_temp_cycle_conversion_time(),
+        get_soil_temp_cycle_readings()
+    );
+    UART_PutString(transmit_buffer);
+    
+    /* Conversion time observed for each sensor */
+    for (uint8 i = 0; i < get_soil_temp_sensor_count(); i++) {
+        sprintf(
+            transmit_buffer,
+            "\tTsoil[%d]: %u bits, %u ms, %u errors, %u failures\r\n",
+            i, get_soil_temp_resolution(i), get_soil_temp_conversion_time(i),
+            get_soil_temp_read_errors(i), get_soil_temp_read_failures(i)
+        );
+        UART_PutString(transmit_buffer);
+    }
+}
+
+/*
+ * @brief Print soil moisture sampling statistics
+ */
+void print_moisture_info()
+{
+    char transmit_buffer[DEF_BUFFER_LENGTH * 2];
+    
+    sprintf(
+        transmit_buffer,
+        "Moisture probes:       %d\r\n"
+        "ADC samples processed: %lu\r\n"
+        "ADC samples dropped:   %lu\r\n"
+        "ADC samples settling:  %lu\r\n",
+        NUMBER_OF_MOISTURE_PROBES,
+        (unsigned long)get_soil_moisture_processed(),
+        (unsigned long)get_soil_moisture_dropped(),
+        (unsigned long)get_soil_moisture_settling()
+    );
+    UART_PutString(transmit_buffer);
+}
+
+/*
+ * @brief Print number of samples rejected as glitches on every channel
+ * @param soil_temp Median filters of soil temperature sensors
+ * @param air_temp  Median filters of air temperature sensors
+ * @param actuator  Median filter of air temperature driving actuators
+ */
+void print_glitch_info(MedianFilter* soil_temp, MedianFilter* air_temp, MedianFilter* actuator)
+{
+    char transmit_buffer[DEF_BUFFER_LENGTH];
+    
+    for (uint8 i = 0; i < get_soil_temp_sensor_count(); i++) {
+        sprintf(transmit_buffer, "\tTsoil[%d]: %lu rejected\r\n", i, (unsigned long)get_median_filter_rejected(&soil_temp[i]));
+        UART_PutString(transmit_buffer);
+    }
+    for (uint8 i = 0; i < get_air_temp_sensor_count(); i++) {
+        sprintf(transmit_buffer, "\tTair[%d]:  %lu rejected\r\n", i, (unsigned long)get_median_filter_rejected(&air_temp[i]));
+        UART_PutString(transmit_buffer);
+    }
+    sprintf(transmit_buffer, "\tActuator: %lu rejected\r\n", (unsigned long)get_median_filter_rejected(actuator));
+    UART_PutString(transmit_buffer);
+}
+
+/*
+ * @brief Print EEPROM row writes caused by logging
+ * @param record_row_writes Row writes done by the last saved record
+ */
+void print_eeprom_info(uint8 record_row_writes)
+{
+    char transmit_buffer[DEF_BUFFER_LENGTH];
+    
+    sprintf(transmit_buffer, "Record size: %u bytes\r\n", (uint)EEPROM_RECORD_SIZE);
+    UART_PutString(transmit_buffer);
+    sprintf(transmit_buffer, "Record slots: %u, next: %u\r\n", (uint)EEPROM_RECORD_SLOTS, log_head_slot);
+    UART_PutString(transmit_buffer);
+    sprintf(transmit_buffer, "Row writes per record: %u\r\n", record_row_writes);
+    UART_PutString(transmit_buffer);
+    sprintf(transmit_buffer, "Row writes total: %lu\r\n", (unsigned long)get_eeprom_row_writes());
+    UART_PutString(transmit_buffer);
+}
+
+/*
+ * @brief Print calibration points and current voltage of every soil moisture probe
+ */
+void print_moisture_calib()
+{
+    char transmit_buffer[DEF_BUFFER_LENGTH];
+    int16 millivolts;
+    uint8 percent;
+    
+    for (uint8 probe = 0; probe < NUMBER_OF_MOISTURE_PROBES; probe++) {
+        sprintf(transmit_buffer, "Probe %d:\r\n", probe);
+        UART_PutString(transmit_buffer);
+        
+        for (uint8 i = 0; get_soil_moisture_calib_point(probe, i, &millivolts, &percent); i++) {
+            sprintf(transmit_buffer, "  Point %d: %d mV = %d %%\r\n", i, millivolts, percent);
+            UART_PutString(transmit_buffer);
+        }
+        
+        if (get_soil_moisture_millivolts(probe, &millivolts)) {
+            sprintf(transmit_buffer, "  Sensor now: %d mV\r\n", millivolts);
+            UART_PutString(transmit_buffer);
+        }
+    }
+}
+
+/*
+ * @brief  Handle CALIB command: CALIB [WET|DRY|RESET|percent [probe]]
+ * @param  args Command arguments following CALIB
+ * @return      True on success
+ */
+uint8 handle_calib_command(const char* args)
+{
+    char  action[8];
+    uint  probe = 0;
+    uint  percent;
+    uint8 success;
+    
+    /* No arguments, print calibration */
+    if (sscanf(args, "%7s %u", action, &probe) < 1) {
+        if (args[0] != '\0') return false;
+        print_moisture_calib();
+        return true;
+    }
+    if (args[0] != ' ' || probe >= NUMBER_OF_MOISTURE_PROBES) return false;
+    
+    if (strcmp(action, "WET") == 0) {
+        success = set_soil_moisture_calib_point(probe, HUMID_MAX);
+    }
+    else if (strcmp(action, "DRY") == 0) {
+        success = set_soil_moisture_calib_point(probe, HUMID_MIN);
+    }
+    else if (strcmp(action, "RESET") == 0) {
+        success = reset_soil_moisture_calib(probe);
+    }
+    else if (sscanf(action, "%u", &percent) == 1 && percent <= HUMID_MAX) {
+        success = set_soil_moisture_calib_point(probe, percent);
+    }
+    else {
+        success = false;
+    }
+    
+    if (success) UART_PutString("Calibration saved.\r\n");
+    return success;
+}
+
+#if PIPELINE_BENCHMARK
+/*
+ * @brief  Decode scratchpad temperature register to float the way the former float path did
+ * @param  lsb Temperature LSB
+ * @param  msb Temperature MSB
+ * @return     Temperature value, C
+ */
+static float decode_temperature_float(uint8 lsb, uint8 msb)
+{
+    int   decimal  = ((msb & 0x07) << 4) | (lsb >> 4);
+    float floating = ((lsb & 0x01) >> 0) * (1 / 16.0) +
+                     ((lsb & 0x02) >> 1) * (1 / 8.0)  +
+                     ((lsb & 0x04) >> 2) * (1 / 4.0)  +
+                     ((lsb & 0x08) >> 3) * (1 / 2.0);
+    float result = decimal + floating;
+    if (msb & 0x80) result *= -1;
+    
+    return result;
+}
+
+/*
+ * @brief Print CPU cycles spent by decoding, averaging and formatting soil temperature
+ * in fixed point and in float. Cycles are counted by DWT cycle counter of Cortex-M3.
+ */
+void print_pipeline_benchmark()
+{
+    static const uint16 raw_samples[] = { 0x0191, 0x00a2, 0x0008, 0x07d0 };  // 25.0625, 10.125, 0.5, 125 C
+    char transmit_buffer[DEF_BUFFER_LENGTH];
+    
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+    
+    /* Fixed point, 1/16 C */
+    uint32 start = DWT->CYCCNT;
+    int32  fixed_sum = 0;
+    for (uint16 i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        uint16 raw = raw_samples[i % 4];
+        fixed_sum += (int16)raw;
+        uint16 average = fixed_sum / (i + 1);
+        sprintf(transmit_buffer, "%u.%04u", average >> SOIL_TEMP_FRACTION_BITS, (average & 0x0f) * 625);
+    }
+    uint32 fixed_cycles = DWT->CYCCNT - start;
+    
+    /* Float, as before */
+    start = DWT->CYCCNT;
+    float float_sum = 0;
+    for (uint16 i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        uint16 raw = raw_samples[i % 4];
+        float_sum += decode_temperature_float(raw & 0xff, raw >> 8);
+        float average = float_sum / (i + 1);
+        sprintf(transmit_buffer, "%.4f", average);
+    }
+    uint32 float_cycles = DWT->CYCCNT - start;
+    
+    sprintf(
+        transmit_buffer,
+        "Fixed point: %lu cycles/sample\r\n",
+        (unsigned long)(fixed_cycles / BENCHMARK_ITERATIONS)
+    );
+    UART_PutString(transmit_buffer);
+    sprintf(
+        transmit_buffer,
+        "Float:       %lu cycles/sample\r\n",
+        (unsigned long)(float_cycles / BENCHMARK_ITERATIONS)
+    );
+    UART_PutString(transmit_buffer);
+}
+#endif
+
 /*
  * @brief Print small reference on how to communicate with device
  */
@@ -548,6 +1159,16 @@ void print_help()
         "T hh:mm      - Set current hours and minutes\n\r"
         "D dd/mm/yyyy - Set current date\n\r"
         "D            - Print current device time\n\r"
+        "O            - Print OneWire bus information\n\r"
+        "M            - Print soil moisture sampling statistics\n\r"
+        "G            - Print number of rejected glitches\n\r"
+        "E            - Print EEPROM row writes\n\r"
+        "R i bits     - Set resolution (9-12) of soil sensor i\n\r"
+        "CALIB        - Print soil moisture calibration\n\r"
+        "CALIB WET i  - Capture wet point of probe i (in water)\n\r"
+        "CALIB DRY i  - Capture dry point of probe i (in air)\n\r"
+        "CALIB p i    - Capture point of p % moisture of probe i\n\r"
+        "CALIB RESET i - Restore default calibration of probe i\n\r"
         "\r\n"
     );   
 }
@@ -560,4 +1181,13 @@ void Timer_OneWire_Restart()
     Control_OneWire_Timer_Reset_Write(0x01);
     CyDelay(1);
     Control_OneWire_Timer_Reset_Write(0x00);
+}
+
+/*
+ * @brief Configure period of OneShot timer that waits for the conversion
+ * @param wait_ms Time to wait in ms
+ */
+void Timer_OneWire_SetWaitTime(uint16 wait_ms)
+{
+    Timer_OneWire_WritePeriod((uint32)wait_ms * TIMER_ONEWIRE_CLOCK_KHZ - 1);
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+/******************************************************************************
+* 
+* @name    TX00DB04 - Programmable System on Chip Design. Median Filter
+* @company Metropolia University of Applied Sciences
+*
+* Median filter is an outlier rejection stage placed in front of the moving average filters.
+* Every sample is inserted to the sliding window, which is kept both in arrival order
+* and sorted. Sorted copy is updated by binary search for the position, O(window) shift,
+* window <= 9, so the median is available at once.
+* Sample deviating from the median by more than .limit is rejected and replaced with
+* the median (Hampel identifier with fixed per-channel limit), a glitch never reaches
+* the averages or actuators. Real step changes pass once they fill half of the window.
+*
+* Samples are integers, use fixed point for fractional values.
+* Window length is odd and at most MEDIAN_FILTER_MAX_LENGTH.
+*
+*******************************************************************************/
+
+#include "median_filter.h"
+
+/*
+ * @brief  Find the first element of sorted array that is not less than the value
+ * @param  sorted Sorted array
+ * @param  count  Number of elements
+ * @param  value  Searched value
+ * @return        Index of the element, count if all elements are less
+ */
+static uint8 lower_bound(const int32* sorted, uint8 count, int32 value)
+{
+    uint8 low = 0;
+    uint8 high = count;
+    
+    while (low < high) {
+        uint8 middle = (low + high) / 2;
+        if (sorted[middle] < value) low = middle + 1;
+        else                        high = middle;
+    }
+    
+    return low;
+}
+
+/*
+ * @brief Initialize the filter as empty
+ * @param filter Target filter
+ * @param length Window length, odd, clamped to MEDIAN_FILTER_MAX_LENGTH
+ * @param limit  Maximum deviation from the median
+ */
+void init_median_filter(MedianFilter* filter, uint8 length, int32 limit)
+{
+    if (length > MEDIAN_FILTER_MAX_LENGTH) length = MEDIAN_FILTER_MAX_LENGTH;
+    if (length % 2 == 0) length--;
+    
+    filter->length       = length;
+    filter->limit        = limit;
+    filter->next_index   = 0;
+    filter->sample_count = 0;
+    filter->rejected     = 0;
+}
+
+/*
+ * @brief  Add new sample to the window and check it against the median
+ * @param  filter Target filter
+ * @param  sample New sample
+ * @param  output Sample to pass further, the median if the sample is rejected
+ * @return        True if the sample was accepted
+ */
+uint8 add_sample_to_median_filter(MedianFilter* filter, const int32 sample, int32* output)
+{
+    uint8 count = filter->sample_count;
+    
+    /* Remove the oldest sample from the sorted copy once the window is filled */
+    if (count == filter->length) {
+        uint8 index = lower_bound(filter->sorted, count, filter->window[filter->next_index]);
+        count--;
+        for (uint8 i = index; i < count; i++) {
+            filter->sorted[i] = filter->sorted[i + 1];
+        }
+    }
+    
+    /* Insert the new sample keeping the order */
+    uint8 index = lower_bound(filter->sorted, count, sample);
+    for (uint8 i = count; i > index; i--) {
+        filter->sorted[i] = filter->sorted[i - 1];
+    }
+    filter->sorted[index] = sample;
+    filter->sample_count = count + 1;
+    
+    filter->window[filter->next_index] = sample;
+    if (++filter->next_index == filter->length) filter->next_index = 0;
+    
+    /* Compare with the median of the window that includes the sample */
+    int32 median = get_median_filtered_result(filter);
+    int32 deviation = sample > median ? sample - median : median - sample;
+    
+    if (filter->sample_count >= MEDIAN_FILTER_MIN_FILL && deviation > filter->limit) {
+        filter->rejected++;
+        *output = median;
+        return 0;
+    }
+    
+    *output = sample;
+    return 1;
+}
+
+/*
+ * @brief  Get the median of the window
+ * @param  filter Target filter
+ * @return        Median, 0 if the filter is empty
+ */
+int32 get_median_filtered_result(MedianFilter* filter)
+{
+    if (filter->sample_count == 0) return 0;
+    
+    return filter->sorted[filter->sample_count / 2];
+}
+
+/*
+ * @brief  Get number of rejected samples
+ * @param  filter Target filter
+ * @return        Number of samples
+ */
+uint32 get_median_filter_rejected(MedianFilter* filter)
+{
+    return filter->rejected;
+}
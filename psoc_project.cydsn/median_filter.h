@@ -0,0 +1,45 @@
+/******************************************************************************
+* 
+* @name    TX00DB04 - Programmable System on Chip Design. Median Filter
+* @company Metropolia University of Applied Sciences
+*
+* Median filter is an outlier rejection stage placed in front of the moving average filters.
+* Every sample is inserted to the sliding window, which is kept both in arrival order
+* and sorted. Sorted copy is updated by binary search for the position, O(window) shift,
+* window <= 9, so the median is available at once.
+* Sample deviating from the median by more than .limit is rejected and replaced with
+* the median (Hampel identifier with fixed per-channel limit), a glitch never reaches
+* the averages or actuators. Real step changes pass once they fill half of the window.
+*
+* Samples are integers, use fixed point for fractional values.
+* Window length is odd and at most MEDIAN_FILTER_MAX_LENGTH.
+*
+*******************************************************************************/
+
+#ifndef MEDIAN_FILTER_H
+#define MEDIAN_FILTER_H
+
+
+#include "project.h"
+
+#define MEDIAN_FILTER_MAX_LENGTH 9   // Maximum window length
+#define MEDIAN_FILTER_MIN_FILL   3   // Samples are not rejected until the window holds this many
+
+typedef struct MedianFilter {
+    int32  window[MEDIAN_FILTER_MAX_LENGTH];  // Samples in arrival order
+    int32  sorted[MEDIAN_FILTER_MAX_LENGTH];  // Samples of the window sorted ascending
+    int32  limit;                             // Maximum deviation from the median
+    uint8  length;                            // Window length
+    uint8  next_index;                        // Index of the sample replaced next
+    uint8  sample_count;                      // Number of samples in the window
+    uint32 rejected;                          // Number of rejected samples
+} MedianFilter;
+
+/* Function declarations */
+void   init_median_filter(MedianFilter* filter, uint8 length, int32 limit);
+uint8  add_sample_to_median_filter(MedianFilter* filter, const int32 sample, int32* output);
+int32  get_median_filtered_result(MedianFilter* filter);
+uint32 get_median_filter_rejected(MedianFilter* filter);
+
+
+#endif
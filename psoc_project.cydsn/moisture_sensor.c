@@ -15,43 +15,431 @@
  * There is no transfer function for the sensor, thus, the oisture is obtained by
  * performing linear mapping from ADC range to percentage.
  *
+ * Every ADC conversion is stored to RAM ring buffer by the ADC interrupt (store_soil_moisture_sample()).
+ * Main loop processes the buffer in blocks, so conversions finishing while main loop is busy are not lost.
+ * Samples that do not fit into the buffer are counted as dropped.
+ *
+ * Multiple probes are sequenced through AMux_Moisture when NUMBER_OF_MOISTURE_PROBES > 1.
+ * The ADC converts continuously and dwells on every probe for MOISTURE_DWELL_SAMPLES conversions.
+ * The first MOISTURE_SETTLE_SAMPLES conversions after switching still hold the previous input
+ * in the delta-sigma decimator and are discarded. Dwelling amortizes the settling, so only
+ * SETTLE / (SETTLE + DWELL) of ADC throughput is lost instead of most of it when switching every sample.
+ *
  * NOTE: Moisture sensor required calibration.
  * MOIST_VALUE_MV is sensor's reading when exposed to water.
  * DRY_VALUE_MV is sensor's reading when exposed to air.
+ * These are defaults only, calibration points are captured at runtime from filtered
+ * millivolts (set_soil_moisture_calib_point()) and persisted in EEPROM.
+ * Up to MOISTURE_CALIB_POINTS points form piecewise linear mapping, slopes of the segments
+ * are precomputed in fixed point, so no float math is done per sample.
  *
  * ========================================
 */
 
 #include "moisture_sensor.h"
+#include "eeprom_layout.h"
+
+/* Calibration points sorted by millivolts, the wettest (highest percent) first */
+typedef struct calib_point {
+    int16 millivolts;
+    uint8 percent;
+} CalibPoint;
+
+/* State of a single probe */
+typedef struct moisture_probe {
+    /* ADC sample ring buffer, head is written by the interrupt and tail by main loop only */
+    int16           samples[MOISTURE_BUFFER_LENGTH];
+    volatile uint16 head;  // Index of the next sample to store
+    volatile uint16 tail;  // Index of the next sample to process
+    
+    /* Millivolts filtered by exponential average, fixed point with MOISTURE_MV_FILTER_SHIFT fractional bits */
+    int32 filtered_mv;
+    uint8 filtered_mv_valid;
+    
+    CalibPoint calib_points[MOISTURE_CALIB_POINTS];
+    int32      calib_slopes[MOISTURE_CALIB_POINTS - 1];  // Percent per millivolt of each segment, Q16
+    uint8      calib_count;
+} MoistureProbe;
+
+static MoistureProbe probes[NUMBER_OF_MOISTURE_PROBES];
+static volatile uint32 samples_dropped   = 0;  // Samples lost because the buffer was full
+static volatile uint32 samples_settling  = 0;  // Samples discarded while the ADC settled after switching
+static uint32          samples_processed = 0;  // Samples converted to moisture
+
+#if NUMBER_OF_MOISTURE_PROBES > 1
+/* Sequencer state, accessed by the interrupt only */
+static uint8  current_probe = 0;
+static uint8  settle_left   = MOISTURE_SETTLE_SAMPLES;
+static uint16 dwell_left    = MOISTURE_DWELL_SAMPLES;
+#endif
+
+/*
+ * @brief  Check that calibration points form monotonic mapping
+ * @param  points Calibration points
+ * @param  count  Number of points
+ * @return        True if the points are valid
+ */
+static uint8 calib_valid(const CalibPoint* points, uint8 count)
+{
+    if (count < 2 || count > MOISTURE_CALIB_POINTS) return 0;
+    
+    for (uint8 i = 0; i < count; i++) {
+        if (points[i].percent > HUMID_MAX) return 0;
+        if (i == 0) continue;
+        // Drier soil gives higher voltage
+        if (points[i].millivolts - points[i - 1].millivolts < MOISTURE_CALIB_MIN_SPAN_MV) return 0;
+        if (points[i].percent >= points[i - 1].percent) return 0;
+    }
+    
+    return 1;
+}
+
+/*
+ * @brief Use calibration points and precompute slopes of the segments
+ * @param probe  Probe to calibrate
+ * @param points Valid calibration points
+ * @param count  Number of points
+ */
+static void apply_calib(MoistureProbe* probe, const CalibPoint* points, uint8 count)
+{
+    for (uint8 i = 0; i < count; i++) {
+        probe->calib_points[i] = points[i];
+    }
+    for (uint8 i = 0; i + 1 < count; i++) {
+        probe->calib_slopes[i] = ((int32)(points[i].percent - points[i + 1].percent) << 16) /
+                                 (points[i + 1].millivolts - points[i].millivolts);
+    }
+    probe->calib_count = count;
+}
+
+/*
+ * @brief Save calibration of the probe to EEPROM
+ * @param index Index of the probe
+ */
+static void save_calib(uint8 index)
+{
+    const MoistureProbe* probe = &probes[index];
+    uint8 out_buffer[MOISTURE_CALIB_SIZE];
+    uint8 length = 0;
+    
+    out_buffer[length++] = MOISTURE_CALIB_MAGIC;
+    out_buffer[length++] = probe->calib_count;
+    for (uint8 i = 0; i < probe->calib_count; i++) {
+        out_buffer[length++] = probe->calib_points[i].millivolts >> 8;
+        out_buffer[length++] = probe->calib_points[i].millivolts;
+        out_buffer[length++] = probe->calib_points[i].percent;
+    }
+    
+    /* Whole entry is written by rows */
+    write_eeprom_block(MOISTURE_CALIB_ADDR + index * MOISTURE_CALIB_SIZE, out_buffer, length, NULL);
+}
+
+/*
+ * @brief  Load calibration of the probe from EEPROM
+ * @param  index Index of the probe
+ * @return       True if valid calibration was stored
+ */
+static uint8 load_calib(uint8 index)
+{
+    CalibPoint points[MOISTURE_CALIB_POINTS];
+    uint16 address = MOISTURE_CALIB_ADDR + index * MOISTURE_CALIB_SIZE;
+    
+    if (EEPROM_ReadByte(address++) != MOISTURE_CALIB_MAGIC) return 0;
+    
+    uint8 count = EEPROM_ReadByte(address++);
+    if (count > MOISTURE_CALIB_POINTS) return 0;
+    
+    for (uint8 i = 0; i < count; i++) {
+        points[i].millivolts = (EEPROM_ReadByte(address) << 8) | EEPROM_ReadByte(address + 1);
+        points[i].percent    = EEPROM_ReadByte(address + 2);
+        address += MOISTURE_CALIB_ENTRY_LEN;
+    }
+    
+    if (!calib_valid(points, count)) return 0;
+    
+    apply_calib(&probes[index], points, count);
+    return 1;
+}
+
+/*
+ * @brief  Map millivolts to moisture using calibration segments
+ * @param  probe      Calibrated probe
+ * @param  millivolts Sensor voltage
+ * @return            Moisture in percents
+ */
+static int mv_to_moisture(const MoistureProbe* probe, int16 millivolts)
+{
+    const CalibPoint* points = probe->calib_points;
+    uint8 last = probe->calib_count - 1;
+    
+    /* Sanity check to filter extreme values */
+    if (millivolts <= points[0].millivolts)    return points[0].percent;
+    if (millivolts >= points[last].millivolts) return points[last].percent;
+    
+    /* Find the segment and perform linear mapping, rounded */
+    uint8 i = 0;
+    while (millivolts > points[i + 1].millivolts) i++;
+    
+    int32 drop = ((int32)(millivolts - points[i].millivolts) * probe->calib_slopes[i] + (1 << 15)) >> 16;
+    return points[i].percent - drop;
+}
 
 /*
  * @brief Initialize moisture sensor's hardware dependencies.
- * It includes ADC DeltaSigma.
+ * It includes ADC DeltaSigma and AMux_Moisture for multiple probes.
+ * Calibration is loaded from EEPROM, EEPROM must be started.
  */
 void initialize_soil_moisture_sensor()
 {
+    for (uint8 i = 0; i < NUMBER_OF_MOISTURE_PROBES; i++) {
+        if (!load_calib(i)) reset_soil_moisture_calib(i);
+    }
+    
+#if NUMBER_OF_MOISTURE_PROBES > 1
+    AMux_Moisture_Start();
+    AMux_Moisture_FastSelect(current_probe);
+#endif
     ADC_DelSig_Start();
     ADC_DelSig_StartConvert();
 }
 
 /*
- * @brief  Get moisute reading. Perform linear mapping.
- * @return Moisture in percents.
+ * @brief Store the last ADC conversion to the ring buffer of the current probe.
+ * Switch to the next probe once the dwell is over. Call from ADC conversion interrupt.
  */
-int get_soil_moisture()
+void store_soil_moisture_sample()
 {
-    int16 raw = ADC_DelSig_CountsTo_mVolts(ADC_DelSig_GetResult16());
+    int16 counts = ADC_DelSig_GetResult16();
+    MoistureProbe* probe = &probes[0];
     
-    /* Sanity check to filter extreme values */
-    if      (raw > DRY_VALUE_MV)   raw = DRY_VALUE_MV;
-    else if (raw < MOIST_VALUE_MV) raw = MOIST_VALUE_MV;
+#if NUMBER_OF_MOISTURE_PROBES > 1
+    // Decimator still holds the previous input
+    if (settle_left) {
+        settle_left--;
+        samples_settling++;
+        return;
+    }
+    
+    probe = &probes[current_probe];
+    
+    // Conversion is complete, switching now does not affect it
+    if (--dwell_left == 0) {
+        current_probe = (current_probe + 1) % NUMBER_OF_MOISTURE_PROBES;
+        AMux_Moisture_FastSelect(current_probe);
+        settle_left = MOISTURE_SETTLE_SAMPLES;
+        dwell_left  = MOISTURE_DWELL_SAMPLES;
+    }
+#endif
+    
+    uint16 head = probe->head;
+    
+    // Buffer is full, main loop has not caught up
+    if ((uint16)(head - probe->tail) >= MOISTURE_BUFFER_LENGTH) {
+        samples_dropped++;
+        return;
+    }
+    
+    probe->samples[head % MOISTURE_BUFFER_LENGTH] = counts;
+    probe->head = head + 1;
+}
+
+/*
+ * @brief  Process block of buffered samples of the probe
+ * @param  index    Index of the probe
+ * @param  moisture Target buffer for moisture in percents
+ * @param  max_len  Maximum number of samples to process
+ * @return          Number of processed samples, 0 if the buffer is empty
+ */
+uint8 read_soil_moisture_block(uint8 index, int* moisture, uint8 max_len)
+{
+    MoistureProbe* probe = &probes[index];
+    uint16 tail = probe->tail;
+    uint16 available = probe->head - tail;
+    uint8  len = available < max_len ? available : max_len;
     
-    /* Perform linear mapping */
-    int moisture = (float)(raw - MOIST_VALUE_MV) / (DRY_VALUE_MV - MOIST_VALUE_MV) * HUMID_MAX;
-    /* Reverse mapped value */
-    moisture = HUMID_MAX - moisture;
+    for (uint8 i = 0; i < len; i++) {
+        int16 millivolts = ADC_DelSig_CountsTo_mVolts(probe->samples[tail++ % MOISTURE_BUFFER_LENGTH]);
+    
+        // Track filtered voltage for calibration
+        if (probe->filtered_mv_valid) {
+            probe->filtered_mv += (((int32)millivolts << MOISTURE_MV_FILTER_SHIFT) - probe->filtered_mv) >> MOISTURE_MV_FILTER_SHIFT;
+        } else {
+            probe->filtered_mv = (int32)millivolts << MOISTURE_MV_FILTER_SHIFT;
+            probe->filtered_mv_valid = 1;
+        }
+    
+        moisture[i] = mv_to_moisture(probe, millivolts);
+    }
+    
+    // Release processed samples to the interrupt
+    probe->tail = tail;
+    samples_processed += len;
+    
+    return len;
+}
+
+/*
+ * @brief  Get number of samples processed since startup
+ * @return Number of samples
+ */
+uint32 get_soil_moisture_processed()
+{
+    return samples_processed;
+}
+
+/*
+ * @brief  Get number of samples dropped because the buffer was full
+ * @return Number of samples
+ */
+uint32 get_soil_moisture_dropped()
+{
+    return samples_dropped;
+}
+
+/*
+ * @brief  Get number of samples discarded while the ADC settled after switching probes
+ * @return Number of samples
+ */
+uint32 get_soil_moisture_settling()
+{
+    return samples_settling;
+}
+
+/*
+ * @brief  Get filtered sensor voltage
+ * @param  index      Index of the probe
+ * @param  millivolts Target for the voltage
+ * @return            True if at least one sample was processed
+ */
+uint8 get_soil_moisture_millivolts(uint8 index, int16* millivolts)
+{
+    const MoistureProbe* probe = &probes[index];
+    
+    if (!probe->filtered_mv_valid) return 0;
+    
+    *millivolts = (probe->filtered_mv + (1 << (MOISTURE_MV_FILTER_SHIFT - 1))) >> MOISTURE_MV_FILTER_SHIFT;
+    return 1;
+}
+
+/*
+ * @brief  Merge captured end point (wet or dry) into the calibration of the probe.
+ * End point wins over the points it conflicts with: points that would not stay monotonic
+ * are dropped. If the opposite end point is dropped as well, it is moved to keep the span
+ * of the defaults, so WET and DRY can be captured in any order whatever the defaults are.
+ * @param  probe    Calibrated probe
+ * @param  captured Captured end point
+ * @param  points   Target for merged calibration points
+ * @return          Number of merged points
+ */
+static uint8 merge_calib_end_point(const MoistureProbe* probe, CalibPoint captured, CalibPoint* points)
+{
+    uint8 wet   = captured.percent == HUMID_MAX;
+    uint8 count = wet ? 1 : 0;  // Wet point is the first one
+    
+    for (uint8 i = 0; i < probe->calib_count; i++) {
+        const CalibPoint* point = &probe->calib_points[i];
+        if (point->percent == captured.percent) continue;
+        
+        // Drier soil gives higher voltage
+        int16 span = wet ? point->millivolts - captured.millivolts : captured.millivolts - point->millivolts;
+        if (span >= MOISTURE_CALIB_MIN_SPAN_MV) points[count++] = *point;
+    }
+    
+    /* Opposite end point was dropped, intermediate points are dropped with it */
+    if (count == (wet ? 1 : 0)) {
+        points[count].percent    = wet ? HUMID_MIN : HUMID_MAX;
+        points[count].millivolts = wet ? captured.millivolts + (DRY_VALUE_MV - MOIST_VALUE_MV) :
+                                         captured.millivolts - (DRY_VALUE_MV - MOIST_VALUE_MV);
+        count++;
+    }
+    
+    if (wet) points[0] = captured;
+    else points[count++] = captured;
+    
+    return count;
+}
+
+/*
+ * @brief  Capture calibration point from filtered sensor voltage and save it to EEPROM.
+ * Point with the same percent is replaced, otherwise new point is inserted.
+ * Wet and dry end points replace the points they conflict with (merge_calib_end_point()).
+ * @param  index   Index of the probe
+ * @param  percent Moisture the sensor is currently exposed to, HUMID_MAX for water and HUMID_MIN for air
+ * @return         True on success, false if the points would not be monotonic or there is no free slot
+ */
+uint8 set_soil_moisture_calib_point(uint8 index, uint8 percent)
+{
+    CalibPoint points[MOISTURE_CALIB_POINTS];
+    CalibPoint captured = { 0, percent };
+    uint8 count = 0;
+    uint8 inserted = 0;
+    
+    if (index >= NUMBER_OF_MOISTURE_PROBES) return 0;
+    if (percent > HUMID_MAX) return 0;
+    if (!get_soil_moisture_millivolts(index, &captured.millivolts)) return 0;
+    
+    const MoistureProbe* probe = &probes[index];
+    
+    if (percent == HUMID_MAX || percent == HUMID_MIN) {
+        count = merge_calib_end_point(probe, captured, points);
+    }
+    else {
+        /* Merge captured point into the table ordered by percent */
+        for (uint8 i = 0; i < probe->calib_count; i++) {
+            if (!inserted && probe->calib_points[i].percent <= percent) {
+                if (count == MOISTURE_CALIB_POINTS) return 0;
+                points[count++] = captured;
+                inserted = 1;
+                // Replace the point captured for the same moisture
+                if (probe->calib_points[i].percent == percent) continue;
+            }
+            if (count == MOISTURE_CALIB_POINTS) return 0;
+            points[count++] = probe->calib_points[i];
+        }
+        if (!inserted) {
+            if (count == MOISTURE_CALIB_POINTS) return 0;
+            points[count++] = captured;
+        }
+    }
+    
+    if (!calib_valid(points, count)) return 0;
+    
+    apply_calib(&probes[index], points, count);
+    save_calib(index);
+    return 1;
+}
+
+/*
+ * @brief  Restore calibration to MOIST_VALUE_MV and DRY_VALUE_MV defaults and save it to EEPROM
+ * @param  index Index of the probe
+ * @return       True on success
+ */
+uint8 reset_soil_moisture_calib(uint8 index)
+{
+    const CalibPoint points[] = { { MOIST_VALUE_MV, HUMID_MAX }, { DRY_VALUE_MV, HUMID_MIN } };
+    
+    if (index >= NUMBER_OF_MOISTURE_PROBES) return 0;
+    
+    apply_calib(&probes[index], points, 2);
+    save_calib(index);
+    return 1;
+}
+
+/*
+ * @brief  Get calibration point
+ * @param  index      Index of the probe
+ * @param  point      Index of the point, the wettest first
+ * @param  millivolts Target for the voltage of the point
+ * @param  percent    Target for the moisture of the point
+ * @return            True if the point exists
+ */
+uint8 get_soil_moisture_calib_point(uint8 index, uint8 point, int16* millivolts, uint8* percent)
+{
+    if (index >= NUMBER_OF_MOISTURE_PROBES || point >= probes[index].calib_count) return 0;
     
-    return moisture;
+    *millivolts = probes[index].calib_points[point].millivolts;
+    *percent    = probes[index].calib_points[point].percent;
+    return 1;
 }
 
-/* [] END OF FILE */
+/* [] END OF FILE */
\ No newline at end of file
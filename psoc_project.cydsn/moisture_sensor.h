@@ -15,9 +15,24 @@
  * There is no transfer function for the sensor, thus, the moisture is obtained by
  * performing linear mapping from ADC range to percentage.
  *
+ * Every ADC conversion is stored to RAM ring buffer by the ADC interrupt (store_soil_moisture_sample()).
+ * Main loop processes the buffer in blocks, so conversions finishing while main loop is busy are not lost.
+ * Samples that do not fit into the buffer are counted as dropped.
+ *
+ * Multiple probes are sequenced through AMux_Moisture when NUMBER_OF_MOISTURE_PROBES > 1.
+ * AMux_Moisture with NUMBER_OF_MOISTURE_PROBES inputs must be placed in front of ADC_DelSig in TopDesign.
+ * The ADC dwells on every probe for MOISTURE_DWELL_SAMPLES conversions, the first MOISTURE_SETTLE_SAMPLES
+ * conversions after switching are discarded while the delta-sigma decimator settles.
+ *
  * NOTE: Moisture sensor required calibration.
  * MOIST_VALUE_MV is sensor's reading when exposed to water.
  * DRY_VALUE_MV is sensor's reading when exposed to air.
+ * These are defaults only, calibration points are captured at runtime from filtered
+ * millivolts (set_soil_moisture_calib_point()) and persisted in EEPROM.
+ * Up to MOISTURE_CALIB_POINTS points form piecewise linear mapping, slopes of the segments
+ * are precomputed in fixed point, so no float math is done per sample.
+ * Wet and dry end points replace the points they conflict with, so they can be captured
+ * in any order regardless of the defaults.
  *
  * ========================================
 */
@@ -33,8 +48,32 @@
 #define HUMID_MIN      0
 #define HUMID_MAX      100
 
-void initialize_soil_moisture_sensor();
-int  get_soil_moisture();
+#define NUMBER_OF_MOISTURE_PROBES 1  // Number of probes, more than one needs AMux_Moisture in TopDesign
+
+#define MOISTURE_BUFFER_LENGTH 64  // Length of ADC sample ring buffer of each probe, power of two
+#define MOISTURE_BLOCK_LENGTH  16  // Maximum number of samples processed in one block
+#define MOISTURE_DWELL_SAMPLES  64  // Conversions kept from one probe before switching to the next
+#define MOISTURE_SETTLE_SAMPLES 4   // Conversions discarded after switching, ADC_DelSig is continuous with 4th order decimator
+
+#define MOISTURE_MV_FILTER_SHIFT     8    // Time constant of millivolt filter used for calibration, 2^shift samples
+#define MOISTURE_CALIB_POINTS        5    // Maximum number of calibration points, two of them are wet and dry
+#define MOISTURE_CALIB_MIN_SPAN_MV   20   // Minimum distance between neighbouring calibration points
+
+/* Calibration of every probe, placed by eeprom_layout.h: MAGIC | COUNT | (MV_MSB | MV_LSB | PERCENT) * MOISTURE_CALIB_POINTS */
+#define MOISTURE_CALIB_MAGIC         0xc5
+#define MOISTURE_CALIB_ENTRY_LEN     3
+#define MOISTURE_CALIB_SIZE          (2 + MOISTURE_CALIB_ENTRY_LEN * MOISTURE_CALIB_POINTS)
+
+void   initialize_soil_moisture_sensor();
+void   store_soil_moisture_sample();
+uint8  read_soil_moisture_block(uint8 index, int* moisture, uint8 max_len);
+uint32 get_soil_moisture_processed();
+uint32 get_soil_moisture_dropped();
+uint32 get_soil_moisture_settling();
+uint8  get_soil_moisture_millivolts(uint8 index, int16* millivolts);
+uint8  set_soil_moisture_calib_point(uint8 index, uint8 percent);
+uint8  reset_soil_moisture_calib(uint8 index);
+uint8  get_soil_moisture_calib_point(uint8 index, uint8 point, int16* millivolts, uint8* percent);
 
     
 #endif
@@ -6,40 +6,105 @@
 * @date    06.04.2022
 *
 * Moving Average Filter is a simple interface for quick calculations
-* and saving of samples to sliding window. 
+* and saving of samples to sliding windows.
 * Instead of storing any variables globally, this interface relies on a structure.
-* Members
-*   samples_window:    Sliding window for storing the samples
-*   sum:               Current sum of the elements in the sliding window
-*                      Allows to avoid heavy calcultions when getting the filter result
-*   raw_sample_number: Number of samples that went through the filter.
-*                      Used for quick calculation of the element that should be replaced in the window
-*                      NOTE: The type of this value defines the upper limit for window length (uint32 MAX)
 *
-* FILTER_LENGTH defines the length of the filter. It is constantly defined,
-* to ensure the memory safety when using the utility.
+* Filters are generated by macros, so every channel group gets window length and sample type it needs.
+* DECLARE_MA_FILTER_BANK(type, prefix, ...) declares structure and functions in a header,
+* DEFINE_MA_FILTER_BANK(type, prefix, ...) defines the functions in a single source file.
+* Results are rounded half away from zero, the division is done by shifting when the window
+* is filled and its length is a power of two. Sum type must hold length * sample range.
+* The running sums are exact integers, so they do not drift however long the device runs.
+* Every query is O(1), the windows are not re-summed while they are filling.
+*
+* Filter bank keeps windows of several channels of the same type in struct-of-arrays layout
+* with one shared write index: samples_windows[slot][channel]. All channels are updated in a single
+* pass over one contiguous row and all averages are computed by one batch call.
+* Channel without valid sample in the tick is marked in valid mask and holds zero in its slot,
+* so the pass has no branches. Masks of the slots take one bit per channel, so a bank of up to
+* 8 channels spends one byte per slot on them. Up to 32 channels, integer samples only:
+*   void add_samples_to_<prefix>_bank(type* bank, const sample_type* samples, uint32 valid_mask)
+*   void get_<prefix>_bank_results(type* bank, sample_type* results)
+*   void reset_<prefix>_bank(type* bank)
 *
 *******************************************************************************/
 
 #ifndef MOVING_AVERAGE_FILTER_H
 #define MOVING_AVERAGE_FILTER_H
 
-    
+
 #include "project.h"
-    
-#define FILTER_LENGTH 30
-
-/* Moving average filter. 
-   Length of the window is defined by FILTER_LENGTH */
-typedef struct MovingAverageFilter {
-    float  samples_window[FILTER_LENGTH];  // Filter window
-    float  sum;                            // Current sum of the samples in the filter
-    uint32 raw_sample_number;              // Number of samples that went through the filter
-} MovingAverageFilter;
-
-/* Function declarations */
-void  add_sample_to_MA_filter(MovingAverageFilter* filter, const float sample);
-float get_MA_filtered_result(MovingAverageFilter* filter);
-
- 
+
+#define MA_IS_POWER_OF_TWO(length) (((length) & ((length) - 1)) == 0)
+#define MA_MASK_BYTES(channels)    (((channels) + 7) / 8)  // Bytes of the valid mask of one bank slot
+
+/* Non-negative value divided by count, shift is used once power of two window is filled */
+#define MA_DIVIDE(sum_type, value, count, length)                                               \
+    (MA_IS_POWER_OF_TWO(length) && (count) == (length) ?                                        \
+        (value) >> __builtin_ctz(length) : (value) / (sum_type)(count))
+
+/* Average of count samples rounded half away from zero, the same way on both division paths */
+#define MA_ROUNDED_AVERAGE(sum_type, sum, count, length)                                        \
+    ((count) == 0 ? 0 :                                                                         \
+     (sum) >= 0 ?  MA_DIVIDE(sum_type, (sum) + (sum_type)((count) / 2), count, length) :       \
+                  -MA_DIVIDE(sum_type, (sum_type)((count) / 2) - (sum), count, length))
+
+/* Structure and function declarations of a filter bank type */
+#define DECLARE_MA_FILTER_BANK(type, prefix, sample_type, sum_type, channels, length)           \
+typedef struct type {                                                                           \
+    sample_type samples_windows[length][channels]; /* Windows of all channels, row per slot */  \
+    sum_type    sums[channels];                    /* Current exact sum of each window */       \
+    uint16      sample_counts[channels];           /* Number of valid samples in each window */ \
+    uint8       valid_masks[length][MA_MASK_BYTES(channels)]; /* Bit of channel holding valid sample in each slot */\
+    uint16      next_index;                        /* Slot replaced next, shared by channels */ \
+} type;                                                                                         \
+void add_samples_to_##prefix##_bank(type* bank, const sample_type* samples, uint32 valid_mask); \
+void get_##prefix##_bank_results(type* bank, sample_type* results);                             \
+void reset_##prefix##_bank(type* bank)
+
+#define DEFINE_MA_FILTER_BANK(type, prefix, sample_type, sum_type, channels, length)            \
+void add_samples_to_##prefix##_bank(type* bank, const sample_type* samples, uint32 valid_mask)  \
+{                                                                                               \
+    sample_type* row      = bank->samples_windows[bank->next_index];                            \
+    uint8*       old_mask = bank->valid_masks[bank->next_index];                                \
+                                                                                                \
+    /* Single pass over the row, invalid samples are stored as zero */                          \
+    for (uint8 i = 0; i < (channels); i++) {                                                    \
+        sample_type sample = ((valid_mask >> i) & 1) ? samples[i] : 0;                          \
+        bank->sums[i] += (sum_type)sample - (sum_type)row[i];                                   \
+        bank->sample_counts[i] += ((valid_mask >> i) & 1) - ((old_mask[i >> 3] >> (i & 7)) & 1);\
+        row[i] = sample;                                                                        \
+    }                                                                                           \
+    for (uint8 i = 0; i < MA_MASK_BYTES(channels); i++) {                                       \
+        old_mask[i] = valid_mask >> (8 * i);                                                    \
+    }                                                                                           \
+                                                                                                \
+    if (++bank->next_index == (length)) bank->next_index = 0;                                   \
+}                                                                                               \
+                                                                                                \
+void get_##prefix##_bank_results(type* bank, sample_type* results)                              \
+{                                                                                               \
+    for (uint8 i = 0; i < (channels); i++) {                                                    \
+        results[i] = MA_ROUNDED_AVERAGE(sum_type, bank->sums[i], bank->sample_counts[i], length);\
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+void reset_##prefix##_bank(type* bank)                                                          \
+{                                                                                               \
+    for (uint16 slot = 0; slot < (length); slot++) {                                            \
+        for (uint8 i = 0; i < (channels); i++) {                                                \
+            bank->samples_windows[slot][i] = 0;                                                 \
+        }                                                                                       \
+        for (uint8 i = 0; i < MA_MASK_BYTES(channels); i++) {                                   \
+            bank->valid_masks[slot][i] = 0;                                                     \
+        }                                                                                       \
+    }                                                                                           \
+    for (uint8 i = 0; i < (channels); i++) {                                                    \
+        bank->sums[i]          = 0;                                                             \
+        bank->sample_counts[i] = 0;                                                             \
+    }                                                                                           \
+    bank->next_index = 0;                                                                       \
+}
+
+
 #endif
@@ -8,29 +8,112 @@
  * URL: https://www.maximintegrated.com/en/design/technical-documents/app-notes/1/126.html [Main logic]
  * URL: https://www.maximintegrated.com/en/design/technical-documents/app-notes/1/187.html [Search logic]
  *
+ * Besides blocking primitives, the interface provides a background engine.
+ * The engine is driven by SysTick interrupt and executes queued transactions
+ * slot by slot. Only the time critical part of the slot (up to 15 us) is spent
+ * inside the interrupt, long low pulses and recovery times are waited by the timer.
+ * Blocking primitives must not be used on the bus while the engine is busy,
+ * nor on any line of the component the engine is driving.
+ *
+ * Every function takes the bus context. The context holds pin access functions
+ * and speed, thus any number of buses can be used independently. Search state is
+ * kept by the caller, so several searches can be interleaved on the same bus.
+ * Background engine serves transactions of all buses one after another.
+ *
+ * Parallel transactions drive up to 8 buses wired to one Pins component in lockstep.
+ * Every time slot of all buses is generated by the same port writes and sampled
+ * by one port read, so the buses are served in the time of one. They are queued
+ * to the engine together with the bus transactions and only touch the lines of the
+ * transaction: the port is written by read-modify-write of the data register.
+ * Buses on lines of a multi-pin component are driven the same way.
+ *
  * ========================================
  */
 
 #include "onewire.h"
+#include <string.h>
 
 /* ============================= */
 /* Private interface definitions */
 /* ============================= */
 
-/* Keep timings static to avoid namespace polution */
-static int A, B, C, D, E, F, G, H, I, J;
-
-/* Search algorithm globals */
-static unsigned char ROM_NO[8];
-static int LastDiscrepancy;
-static int LastFamilyDiscrepancy;
-static int LastDeviceFlag;
-static unsigned char crc8;
+/* Timings for both speeds in ticks of 0.25 us, indexed by OVERDRIVE/STANDARD.
+   Overdrive read slot is sampled at A + E = 1.75 us, within 2 us the slave holds '0' */
+typedef struct onewire_timings {
+    int A, B, C, D, E, F, G, H, I, J;
+} OneWireTimings;
+
+static const OneWireTimings timings[] = {
+    [OVERDRIVE] = { 4, 30, 30, 10, 3, 28, 10, 280, 34, 160 },
+    [STANDARD]  = { 6 * 4, 64 * 4, 60 * 4, 10 * 4, 9 * 4, 55 * 4, 0, 480 * 4, 200 * 4, 410 * 4 }
+};
+
+#define ENGINE_MIN_TICKS 4  // Shortest interval between engine interrupts
+
+/* Background engine states */
+typedef enum {
+    ENGINE_IDLE,           // Waiting for the transaction
+    ENGINE_RESET_RELEASE,  // Reset pulse is being driven
+    ENGINE_RESET_SAMPLE,   // Bus released, waiting for presence pulse
+    ENGINE_SLOT,           // Ready to start next time slot
+    ENGINE_SLOT_RELEASE    // Write '0' low pulse is being driven
+} EngineState;
+
+/* Background engine globals */
+static OneWireTransaction* volatile queue[ONEWIRE_QUEUE_LENGTH];
+static OneWireParallelTransaction* volatile parallel_queue[ONEWIRE_QUEUE_LENGTH];  // Set if the place holds parallel transaction
+static volatile uint8 queue_head = 0;  // Index of the transaction in progress
+static volatile uint8 queue_tail = 0;  // Index of the next free queue place
+static EngineState engine_state = ENGINE_IDLE;
+static uint8 engine_bit_index;         // Index of the next bit to touch in transaction
+static volatile uint32 engine_bus_time = 0;  // Time the bus spent in transactions, us
+static volatile uint32 engine_time = 0;      // Time elapsed since the engine start, us
 
 // One tick is 0.25 us according to standards
+// Delay is cycle counted to keep sub-microsecond precision required by overdrive
 static void tick_delay(int ticks)
 {
-    CyDelayUs(ticks / 4);
+    CyDelayCycles(ticks * BCLK__BUS_CLK__MHZ / 4);
+}
+
+// Drive (LOW) or release (HIGH) the bus, the other pins of the component keep their state
+static void bus_write(OneWireBus* bus, uint8 level)
+{
+    if (bus->read_data_reg == NULL) {
+        bus->write(level);
+        return;
+    }
+    
+    uint8 value = bus->read_data_reg() & ~bus->mask;
+    bus->write(level ? value | bus->mask : value);
+}
+
+// Sample the bus
+static uint8 bus_read(OneWireBus* bus)
+{
+    return (bus->read() & bus->mask) != 0;
+}
+
+// Drive lines of the port to the values of bits, the other pins keep their state
+static void port_write(OneWireParallel* port, uint8 lines, uint8 bits)
+{
+    port->write((port->read_data_reg() & ~lines) | (bits & lines));
+}
+
+// Account time spent by the engine
+static void engine_account(int ticks)
+{
+    engine_time += ticks / 4;
+    if (engine_state != ENGINE_IDLE) engine_bus_time += ticks / 4;
+}
+
+// Schedule the next engine interrupt after the specified amount of ticks
+static void engine_arm(int ticks)
+{
+    engine_account(ticks);
+    
+    CySysTickSetReload(ticks * BCLK__BUS_CLK__MHZ / 4);
+    CySysTickClear();
 }
 
 /* =============================*/
@@ -38,97 +121,104 @@ static void tick_delay(int ticks)
 /* =============================*/
 
 /* 
- * @brief Configure timings.
- * Only available for standard mode due to delay precision issues.
+ * @brief Configure timings of blocking primitives.
+ * Background engine chooses the speed per transaction.
+ * @param bus      Target bus
+ * @param standard STANDARD or OVERDRIVE
  */
-void set_speed()
+void set_speed(OneWireBus* bus, uint8 standard)
 {
-    // Standard Speed
-    A = 6 * 4;
-    B = 64 * 4;
-    C = 60 * 4;
-    D = 10 * 4;
-    E = 9 * 4;
-    F = 55 * 4;
-    G = 0;
-    H = 480 * 4;
-    I = 200 * 4;
-    J = 410 * 4;
+    bus->speed = standard ? STANDARD : OVERDRIVE;
 }
 
 /* 
  * @brief  Generate a 1-Wire reset, return 1 if no presence detected.
+ * @param  bus Target bus
  * @return Presence in boolean format, reverse
  */
-uint8 onewire_touch_reset()
+uint8 onewire_touch_reset(OneWireBus* bus)
 {
+    const OneWireTimings* t = &timings[bus->speed];
     int result;
     
-    /* GHIJ */
-    tick_delay(G);
-    OneWire_Pin_Write(LOW);
-    tick_delay(H);
-    OneWire_Pin_Write(HIGH);     // Releases the bus
-    tick_delay(I);
-    result = OneWire_Pin_Read() ^ 0x01;      // Sample for presence pulse from slave
-    tick_delay(J);               // Complete the reset sequence recovery
+    /* GHIJ, interrupts are held off until the presence pulse is sampled */
+    uint8 interrupt_state = CyEnterCriticalSection();
+    tick_delay(t->G);
+    bus_write(bus, LOW);
+    tick_delay(t->H);
+    bus_write(bus, HIGH);     // Releases the bus
+    tick_delay(t->I);
+    result = bus_read(bus) ^ 0x01;  // Sample for presence pulse from slave
+    CyExitCriticalSection(interrupt_state);
+    tick_delay(t->J);               // Complete the reset sequence recovery
     
     return result; // Return sample presence pulse result
 }
 
 /*
  * @brief  Send a OneWire write bit. Provide 10 us recovery time
+ * @param  bus  Target bus
  * @param  bit  Bit of data
  */
-void onewire_write_bit(uint8 bit)
+void onewire_write_bit(OneWireBus* bus, uint8 bit)
 {
+    const OneWireTimings* t = &timings[bus->speed];
+    
+    // Interrupt inside the slot would stretch it, the slot is timed with interrupts off
+    uint8 interrupt_state = CyEnterCriticalSection();
     if (bit) {
         // Write '1' bit - AB
-        OneWire_Pin_Write(LOW); // Drives DQ low
-        tick_delay(A);
-        OneWire_Pin_Write(HIGH); // Releases the bus
-        tick_delay(B);       // Complete the time slot and 10us recovery
+        bus_write(bus, LOW);  // Drives DQ low
+        tick_delay(t->A);
+        bus_write(bus, HIGH); // Releases the bus
+        tick_delay(t->B);       // Complete the time slot and 10us recovery
     }
     else {
         // Write '0' bit - CD
-        OneWire_Pin_Write(LOW); // Drives DQ low
-        tick_delay(C);
-        OneWire_Pin_Write(HIGH); // Releases the bus
-        tick_delay(D);
+        bus_write(bus, LOW);  // Drives DQ low
+        tick_delay(t->C);
+        bus_write(bus, HIGH); // Releases the bus
+        tick_delay(t->D);
     }
+    CyExitCriticalSection(interrupt_state);
 }
 
 /*
  * @brief  Read a OneWire bit. Provide 10 us recovery time
+ * @param  bus Target bus
  * @return Bit of data
  */
-uint8 onewire_read_bit()
+uint8 onewire_read_bit(OneWireBus* bus)
 {
+    const OneWireTimings* t = &timings[bus->speed];
     int result;
     
-    /* AEF */
-    OneWire_Pin_Write(LOW);             // Drives DQ low
-    tick_delay(A);
-    OneWire_Pin_Write(HIGH);            // Releases the bus
-    tick_delay(E);
-    result = OneWire_Pin_Read() & 0x01; // Sample the bit value from the slave
-    tick_delay(F);                      // Complete the time slot and 10us recovery
+    /* AEF, the slot is timed with interrupts off */
+    uint8 interrupt_state = CyEnterCriticalSection();
+    bus_write(bus, LOW);         // Drives DQ low
+    tick_delay(t->A);
+    bus_write(bus, HIGH);        // Releases the bus
+    tick_delay(t->E);
+    result = bus_read(bus);      // Sample the bit value from the slave
+    tick_delay(t->F);                      // Complete the time slot and 10us recovery
+    CyExitCriticalSection(interrupt_state);
 
     return result;
 }
 
 /*
  * @brief  Write OneWire data byte
+ * @param  bus   Target bus
  * @param  data  Target byte
  */
-void onewire_write_byte(uint8 data)
+void onewire_write_byte(OneWireBus* bus, uint8 data)
 {
     int loop;
 
     // Loop to write each bit in the byte, LS-bit first
     for (loop = 0; loop < BYTE_LEN; loop++)
     {
-        onewire_write_bit(data & 0x01);
+        onewire_write_bit(bus, data & 0x01);
 
         // Shift the data byte for the next bit
         data >>= 1;
@@ -137,9 +227,10 @@ void onewire_write_byte(uint8 data)
 
 /*
  * @brief  Read OneWire data byte and return it
+ * @param  bus Target bus
  * @return Sampled byte
  */
-uint8 onewire_read_byte(void)
+uint8 onewire_read_byte(OneWireBus* bus)
 {
     int loop, result=0;
 
@@ -149,17 +240,18 @@ uint8 onewire_read_byte(void)
         result >>= 1;
 
         // if result is one, then set MS bit
-        if (onewire_read_bit()) result |= 0x80;
+        if (onewire_read_bit(bus)) result |= 0x80;
     }
     return result;
 }
 
 /*
  * @brief  Write a OneWire data byte and return the sampled result
+ * @param  bus   Target bus
  * @param  data  Target byte
  * @return       Sampled result
  */
-uint8 onewire_touch_byte(uint8 data)
+uint8 onewire_touch_byte(OneWireBus* bus, uint8 data)
 {
     int loop, result = 0;
 
@@ -171,10 +263,10 @@ uint8 onewire_touch_byte(uint8 data)
         // If sending a '1' then read a bit else write a '0'
         if (data & 0x01)
         {
-            if (onewire_read_bit()) result |= 0x80;
+            if (onewire_read_bit(bus)) result |= 0x80;
         }
         else
-            onewire_write_bit(0);
+            onewire_write_bit(bus, 0);
 
         // Shift the data byte for the next bit
         data >>= 1;
@@ -185,52 +277,419 @@ uint8 onewire_touch_byte(uint8 data)
 /*
  * @brief  Write a block OneWire data bytes and return
  * the sampled result in the same buffer
+ * @param  bus      Target bus
  * @param  data     Target data
  * @param  data_len Number of bytes
  */
-void onewire_block(unsigned char *data, int data_len)
+void onewire_block(OneWireBus* bus, unsigned char *data, int data_len)
 {
     int loop;
 
     for (loop = 0; loop < data_len; loop++)
     {
-        data[loop] = onewire_touch_byte(data[loop]);
+        data[loop] = onewire_touch_byte(bus, data[loop]);
+    }
+}
+
+static void engine_slot();
+static void engine_parallel_slot();
+
+/*
+ * @brief  Set the device with specified ROM code to overdrive speed.
+ * Standard speed devices ignore the command, thus the result can be used for
+ * speed negotiation. Blocking primitives are left at overdrive speed.
+ * @param  bus      Target bus
+ * @param  rom_code Device address
+ * @return True if the device answered at overdrive speed
+ */
+uint8 onewire_overdrive_match(OneWireBus* bus, uint64 rom_code)
+{
+    set_speed(bus, STANDARD);
+    
+    // Reset all devices to standard speed
+    if (onewire_touch_reset(bus)) return 0;
+    
+    /* Command is sent at standard speed, address is sent at overdrive speed */
+    onewire_write_byte(bus, CMD_ROM_OVERDRIVE_MATCH);
+    set_speed(bus, OVERDRIVE);
+    for (uint8 i = 0; i < 8; i++) {
+        onewire_write_byte(bus, rom_code >> (BYTE_LEN * i));
+    }
+    
+    return !onewire_touch_reset(bus);
+}
+
+/*
+ * @brief Drive or release all lines of the transaction in progress
+ * @param level LOW or HIGH
+ */
+static void engine_drive(uint8 level)
+{
+    OneWireParallelTransaction* parallel = parallel_queue[queue_head];
+    
+    if (parallel != NULL) port_write(parallel->port, parallel->lines, level ? 0xff : 0x00);
+    else bus_write(queue[queue_head]->bus, level);
+}
+
+/*
+ * @brief  Sample presence pulse of the transaction in progress
+ * @return True if at least one device answered
+ */
+static uint8 engine_presence()
+{
+    OneWireParallelTransaction* parallel = parallel_queue[queue_head];
+    
+    if (parallel == NULL) return !bus_read(queue[queue_head]->bus);
+    
+    parallel->presence = ~parallel->port->read() & parallel->lines;
+    return parallel->presence != 0;
+}
+
+/*
+ * @brief Take next transaction from the queue and start it.
+ * Engine is left idle if there is nothing to do.
+ */
+static void engine_start_transaction()
+{
+    if (queue_head == queue_tail) {
+        engine_state = ENGINE_IDLE;
+        engine_arm(ONEWIRE_IDLE_PERIOD_US * 4);
+        return;
+    }
+    
+    OneWireParallelTransaction* parallel = parallel_queue[queue_head];
+    
+    engine_bit_index = 0;
+    if (parallel != NULL ? parallel->reset : queue[queue_head]->reset) {
+        /* GH */
+        engine_drive(LOW);
+        engine_state = ENGINE_RESET_RELEASE;
+        engine_arm(timings[STANDARD].H);
+    }
+    else {
+        // No reset required, start touching the data straight away
+        engine_state = ENGINE_SLOT;
+        engine_slot();
     }
 }
 
+/*
+ * @brief Complete transaction in progress with the specified status
+ * and continue with the next one
+ * @param status Resulting status of the transaction
+ */
+static void engine_finish_transaction(uint8 status)
+{
+    if (parallel_queue[queue_head] != NULL) parallel_queue[queue_head]->status = status;
+    else queue[queue_head]->status = status;
+    queue_head = (queue_head + 1) % ONEWIRE_QUEUE_LENGTH;
+    
+    engine_start_transaction();
+}
+
+/*
+ * @brief Start next time slot of the transaction in progress.
+ * Reading or writing '1' are handled in place, because the sample
+ * must be taken within 15 us from the start of the slot.
+ * Overdrive slots are too short for the timer and are handled in place completely.
+ */
+static void engine_slot()
+{
+    if (parallel_queue[queue_head] != NULL) {
+        engine_parallel_slot();
+        return;
+    }
+    
+    OneWireTransaction* transaction = queue[queue_head];
+    OneWireBus* bus = transaction->bus;
+    
+    // Whole data block was touched
+    if (engine_bit_index == transaction->data_len * BYTE_LEN) {
+        engine_finish_transaction(ONEWIRE_TR_DONE);
+        return;
+    }
+    
+    uint8 byte_index = engine_bit_index / BYTE_LEN;
+    uint8 bit_mask   = 1 << (engine_bit_index % BYTE_LEN);
+    uint8 overdrive  = transaction->overdrive && byte_index > 0;
+    const OneWireTimings* speed = &timings[overdrive ? OVERDRIVE : STANDARD];
+    
+    if (transaction->data[byte_index] & bit_mask) {
+        /* AEF, same as onewire_read_bit() */
+        bus_write(bus, LOW);
+        tick_delay(speed->A);
+        bus_write(bus, HIGH);
+        tick_delay(speed->E);
+        // Keep touched bit as is if slave released the bus
+        if (!bus_read(bus)) transaction->data[byte_index] &= ~bit_mask;
+        
+        engine_account(speed->A + speed->E);
+        engine_bit_index++;
+        
+        if (!overdrive) {
+            engine_arm(speed->F);
+            return;
+        }
+        tick_delay(speed->F);
+        engine_account(speed->F);
+    }
+    else if (!overdrive) {
+        /* CD, release is done in the next interrupt */
+        bus_write(bus, LOW);
+        engine_state = ENGINE_SLOT_RELEASE;
+        engine_arm(speed->C);
+        return;
+    }
+    else {
+        /* CD */
+        bus_write(bus, LOW);
+        tick_delay(speed->C);
+        bus_write(bus, HIGH);
+        tick_delay(speed->D);
+        
+        engine_account(speed->C + speed->D);
+        engine_bit_index++;
+    }
+    
+    // Overdrive slot is completed, continue as soon as possible
+    engine_arm(ENGINE_MIN_TICKS);
+}
+
+/*
+ * @brief Start next time slot of the parallel transaction in progress.
+ * Write '1' and read slots are the same, thus every line either writes '0'
+ * or writes '1' and samples the answer in the same slot. All lines are driven low
+ * together, write '1' lines are released after A and sampled, write '0' lines
+ * are released in the next interrupt.
+ */
+static void engine_parallel_slot()
+{
+    OneWireParallelTransaction* transaction = parallel_queue[queue_head];
+    OneWireParallel* port = transaction->port;
+    const OneWireTimings* speed = &timings[STANDARD];
+    
+    // Whole data block was touched
+    if (engine_bit_index == transaction->data_len * BYTE_LEN) {
+        engine_finish_transaction(ONEWIRE_TR_DONE);
+        return;
+    }
+    
+    uint8* row     = transaction->data[engine_bit_index / BYTE_LEN];
+    uint8 bit_mask = 1 << (engine_bit_index % BYTE_LEN);
+    
+    /* Slice the bit of every line into one port value */
+    uint8 bits = 0;
+    for (uint8 line = 0; line < ONEWIRE_PARALLEL_LINES; line++) {
+        if (row[line] & bit_mask) bits |= 1 << line;
+    }
+    
+    /* AE(F) for write '1' lines, C(D) for write '0' lines */
+    port_write(port, transaction->lines, 0x00);
+    tick_delay(speed->A);
+    port_write(port, transaction->lines, bits);
+    tick_delay(speed->E);
+    uint8 sampled = port->read();
+    
+    // Keep touched bit as is if slave released the line
+    for (uint8 line = 0; line < ONEWIRE_PARALLEL_LINES; line++) {
+        if (!(sampled & (1 << line))) row[line] &= ~bit_mask;
+    }
+    engine_account(speed->A + speed->E);
+    
+    if ((bits & transaction->lines) != transaction->lines) {
+        engine_state = ENGINE_SLOT_RELEASE;
+        engine_arm(speed->C - speed->A - speed->E);
+        return;
+    }
+    
+    engine_bit_index++;
+    engine_arm(speed->F);
+}
+
+/*
+ * @brief Background engine SysTick callback.
+ * Every call advances the transaction in progress to the next timing point.
+ */
+static void engine_tick()
+{
+    if (engine_state == ENGINE_IDLE) {
+        engine_start_transaction();
+        return;
+    }
+    
+    switch (engine_state) {
+        case ENGINE_RESET_RELEASE:
+            engine_drive(HIGH);  // Releases the bus
+            engine_state = ENGINE_RESET_SAMPLE;
+            engine_arm(timings[STANDARD].I);
+            break;
+        case ENGINE_RESET_SAMPLE:
+            // No presence pulse from slave, abandon the transaction
+            if (!engine_presence()) {
+                engine_finish_transaction(ONEWIRE_TR_NO_PRESENCE);
+                break;
+            }
+            engine_state = ENGINE_SLOT;
+            engine_arm(timings[STANDARD].J);  // Complete the reset sequence recovery
+            break;
+        case ENGINE_SLOT:
+            engine_slot();
+            break;
+        case ENGINE_SLOT_RELEASE:
+            engine_drive(HIGH);  // Releases the bus
+            engine_bit_index++;
+            engine_state = ENGINE_SLOT;
+            engine_arm(timings[STANDARD].D);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * @brief Start background engine.
+ * Speed must be configured beforehand.
+ */
+void onewire_engine_start()
+{
+    engine_state = ENGINE_IDLE;
+    
+    CySysTickStart();
+    CySysTickSetCallback(0, engine_tick);
+    engine_arm(ONEWIRE_IDLE_PERIOD_US * 4);
+}
+
+/*
+ * @brief  Queue transaction for the background engine.
+ * The transaction must stay allocated until it is completed.
+ * @param  transaction Transaction to queue
+ * @return             True if the transaction was queued, false if the queue is full
+ */
+uint8 onewire_submit(OneWireTransaction* transaction)
+{
+    uint8 next_tail = (queue_tail + 1) % ONEWIRE_QUEUE_LENGTH;
+    if (next_tail == queue_head) return 0;
+    
+    transaction->status = ONEWIRE_TR_QUEUED;
+    queue[queue_tail] = transaction;
+    parallel_queue[queue_tail] = NULL;
+    queue_tail = next_tail;  // Publish the transaction to the engine
+    
+    return 1;
+}
+
+/*
+ * @brief  Queue parallel transaction for the background engine.
+ * The transaction must stay allocated until it is completed.
+ * @param  transaction Transaction to queue
+ * @return             True if the transaction was queued, false if the queue is full
+ */
+uint8 onewire_submit_parallel(OneWireParallelTransaction* transaction)
+{
+    uint8 next_tail = (queue_tail + 1) % ONEWIRE_QUEUE_LENGTH;
+    if (next_tail == queue_head) return 0;
+    
+    transaction->lines &= transaction->port->lines;
+    transaction->presence = 0;
+    transaction->status = ONEWIRE_TR_QUEUED;
+    parallel_queue[queue_tail] = transaction;
+    queue_tail = next_tail;  // Publish the transaction to the engine
+    
+    return 1;
+}
+
+/*
+ * @brief  Check if all queued transactions are completed
+ * @return True if the engine has nothing to do
+ */
+uint8 onewire_engine_idle()
+{
+    return queue_head == queue_tail;
+}
+
+/*
+ * @brief  Get total time the bus spent in background transactions.
+ * The counter wraps around, use differences between two readings.
+ * @return Bus time in microseconds
+ */
+uint32 onewire_bus_time()
+{
+    return engine_bus_time;
+}
+
+/*
+ * @brief  Get time elapsed since the engine start.
+ * The counter wraps around, use differences between two readings.
+ * @return Time in microseconds
+ */
+uint32 onewire_time()
+{
+    return engine_time;
+}
+
 /*
  * @brief  Find the 'first' devices on the 1-Wire bus
- * @return TRUE  : device found, ROM number in ROM_NO buffer
+ * @param  bus    Target bus
+ * @param  search Search state, kept by the caller between the calls
+ * @param  buf    Found ROM code
+ * @return TRUE  : device found, ROM number in search->ROM_NO buffer
  *         FALSE : no device present
  */
-int onewire_first(uint64* buf)
+int onewire_first(OneWireBus* bus, OneWireSearch* search, uint64* buf)
 {
    // reset the search state
-   LastDiscrepancy = 0;
-   LastDeviceFlag = 0;
-   LastFamilyDiscrepancy = 0;
+   search->LastDiscrepancy = 0;
+   search->LastDeviceFlag = 0;
+   search->LastFamilyDiscrepancy = 0;
+   search->search_command = CMD_ROM_SEARCH;
 
-   return onewire_search(buf);
+   return onewire_search(bus, search, buf);
+}
+
+/*
+ * @brief  Find the 'first' device in alarm state on the 1-Wire bus.
+ * Devices are found by ALARM SEARCH command, onewire_next() continues the same search.
+ * @param  bus    Target bus
+ * @param  search Search state, kept by the caller between the calls
+ * @param  buf    Found ROM code
+ * @return TRUE  : device found, ROM number in search->ROM_NO buffer
+ *         FALSE : no device in alarm state
+ */
+int onewire_alarm_first(OneWireBus* bus, OneWireSearch* search, uint64* buf)
+{
+   // reset the search state
+   search->LastDiscrepancy = 0;
+   search->LastDeviceFlag = 0;
+   search->LastFamilyDiscrepancy = 0;
+   search->search_command = CMD_ROM_ALARM_SEARCH;
+
+   return onewire_search(bus, search, buf);
 }
 
 /*
  * @brief  Find the 'next' devices on the 1-Wire bus
- * @return TRUE  : device found, ROM number in ROM_NO buffer
+ * @param  bus    Target bus
+ * @param  search Search state, kept by the caller between the calls
+ * @param  buf    Found ROM code
+ * @return TRUE  : device found, ROM number in search->ROM_NO buffer
  *         FALSE : no device present
  */
-int onewire_next(uint64* buf)
+int onewire_next(OneWireBus* bus, OneWireSearch* search, uint64* buf)
 {
    // leave the search state alone
-   return onewire_search(buf);
+   return onewire_search(bus, search, buf);
 }
 
 /*
  * @brief  Perform the 1-Wire Search Algorithm on the 1-Wire bus using the existing
  * search state.
- * @return TRUE  : device found, ROM number in ROM_NO buffer
+ * @param  bus    Target bus
+ * @param  search Search state, kept by the caller between the calls
+ * @param  buf    Found ROM code
+ * @return TRUE  : device found, ROM number in search->ROM_NO buffer
  *         FALSE : device not found, end of search
  */
-int onewire_search(uint64* buf)
+int onewire_search(OneWireBus* bus, OneWireSearch* search, uint64* buf)
 {
    int id_bit_number;
    int last_zero, rom_byte_number, search_result;
@@ -243,30 +702,30 @@ int onewire_search(uint64* buf)
    rom_byte_number = 0;
    rom_byte_mask = 1;
    search_result = 0;
-   crc8 = 0;
+   search->crc8 = 0;
 
    // if the last call was not the last one
-    if (!LastDeviceFlag)
+    if (!search->LastDeviceFlag)
     {
         // 1-Wire reset
-        if (onewire_touch_reset())
+        if (onewire_touch_reset(bus))
         {
             // reset the search
-            LastDiscrepancy = 0;
-            LastDeviceFlag = 0;
-            LastFamilyDiscrepancy = 0;
+            search->LastDiscrepancy = 0;
+            search->LastDeviceFlag = 0;
+            search->LastFamilyDiscrepancy = 0;
             return 0;
         }
 
         // issue the search command 
-        onewire_write_byte(0xF0);  
+        onewire_write_byte(bus, search->search_command);  
 
         // loop to do the search
         do
         {
             // read a bit and its complement
-            id_bit = onewire_read_bit();
-            cmp_id_bit = onewire_read_bit();
+            id_bit = onewire_read_bit(bus);
+            cmp_id_bit = onewire_read_bit(bus);
 
             // check for no devices on 1-wire
             if ((id_bit == 1) && (cmp_id_bit == 1))
@@ -280,11 +739,11 @@ int onewire_search(uint64* buf)
                 {
                     // if this discrepancy if before the Last Discrepancy
                     // on a previous next then pick the same as last time
-                    if (id_bit_number < LastDiscrepancy)
-                        search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
+                    if (id_bit_number < search->LastDiscrepancy)
+                        search_direction = ((search->ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
                     else
                         // if equal to last pick 1, if not then pick 0
-                        search_direction = (id_bit_number == LastDiscrepancy);
+                        search_direction = (id_bit_number == search->LastDiscrepancy);
 
                     // if 0 was picked then record its position in LastZero
                     if (search_direction == 0)
@@ -293,19 +752,19 @@ int onewire_search(uint64* buf)
 
                         // check for Last discrepancy in family
                         if (last_zero < 9)
-                            LastFamilyDiscrepancy = last_zero;
+                            search->LastFamilyDiscrepancy = last_zero;
                     }
                 }
 
                 // set or clear the bit in the ROM byte rom_byte_number
                 // with mask rom_byte_mask
                 if (search_direction == 1)
-                    ROM_NO[rom_byte_number] |= rom_byte_mask;
+                    search->ROM_NO[rom_byte_number] |= rom_byte_mask;
                 else
-                    ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+                    search->ROM_NO[rom_byte_number] &= ~rom_byte_mask;
 
                 // serial number search direction write bit
-                onewire_write_bit(search_direction);
+                onewire_write_bit(bus, search_direction);
 
                 // increment the byte counter id_bit_number
                 // and shift the mask rom_byte_mask
@@ -315,7 +774,7 @@ int onewire_search(uint64* buf)
                 // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
                 if (rom_byte_mask == 0)
                 {
-                    docrc8(ROM_NO[rom_byte_number]);  // accumulate the CRC
+                    docrc8(search, search->ROM_NO[rom_byte_number]);  // accumulate the CRC
                     rom_byte_number++;
                     rom_byte_mask = 1;
                 }
@@ -324,28 +783,28 @@ int onewire_search(uint64* buf)
         while(rom_byte_number < 8);  // loop until through all ROM bytes 0-7
 
         // if the search was successful then
-        if (!((id_bit_number < 65) || (crc8 != 0)))
+        if (!((id_bit_number < 65) || (search->crc8 != 0)))
         {
-            // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-            LastDiscrepancy = last_zero;
+            // search successful so set search->LastDiscrepancy,search->LastDeviceFlag,search_result
+            search->LastDiscrepancy = last_zero;
 
             // check for last device
-            if (LastDiscrepancy == 0)
-                LastDeviceFlag = 1;
+            if (search->LastDiscrepancy == 0)
+                search->LastDeviceFlag = 1;
              
             search_result = 1;
         }
     }
 
     // if no device found then reset counters so next 'search' will be like a first
-    if (!search_result || !ROM_NO[0])
+    if (!search_result || !search->ROM_NO[0])
     {
-        LastDiscrepancy = 0;
-        LastDeviceFlag = 0;
-        LastFamilyDiscrepancy = 0;
+        search->LastDiscrepancy = 0;
+        search->LastDeviceFlag = 0;
+        search->LastFamilyDiscrepancy = 0;
         search_result = 0;
     }
-    else memcpy(buf, ROM_NO, 8);
+    else memcpy(buf, search->ROM_NO, 8);
 
     return search_result;
 }
@@ -370,14 +829,32 @@ static unsigned char dscrc_table[] = {
 
 /*
  * @brief  Calculate the CRC8 of the byte value provided with the current 
- * global 'crc8' value. 
- * @return Current global crc8 value
+ * 'crc8' value of the search. 
+ * @param  search Search state holding the crc8 accumulator
+ * @param  value  Byte to accumulate
+ * @return Current crc8 value of the search
  */
-unsigned char docrc8(unsigned char value)
+unsigned char docrc8(OneWireSearch* search, unsigned char value)
 {
    // See Application Note 27
     
-   crc8 = dscrc_table[crc8 ^ value];
-   return crc8;
+   search->crc8 = dscrc_table[search->crc8 ^ value];
+   return search->crc8;
+}
+
+/*
+ * @brief  Calculate the CRC8 of the data block without touching any bus state
+ * @param  data Target data
+ * @param  len  Number of bytes
+ * @return CRC8 of the data, zero over data followed by its CRC byte
+ */
+uint8 onewire_crc8(const uint8* data, uint8 len)
+{
+    uint8 crc = 0;
+    for (uint8 i = 0; i < len; i++) {
+        crc = dscrc_table[crc ^ data[i]];
+    }
+    
+    return crc;
 }
 
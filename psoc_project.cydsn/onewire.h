@@ -9,6 +9,12 @@
  * Binary search algorithm is partially adopted from Maxim Integrated.
  * URL: https://www.maximintegrated.com/en/design/technical-documents/app-notes/1/187.html
  *
+ * All functions operate on the bus context. To add a bus, place another Pins component
+ * on TopDesign and initialize the context with ONEWIRE_BUS(<component name>).
+ * Buses can also be lines of one multi-pin Pins component, ONEWIRE_BUS_LINE(<component name>, <line>).
+ * Such buses can be driven in lockstep by parallel transactions of the background engine,
+ * initialize the port with ONEWIRE_PARALLEL(<component name>, <mask>).
+ *
  * ========================================
  */
 
@@ -25,30 +31,127 @@
 #define LOW        0x00
 #define HIGH       0x01
     
-#define CMD_ROM_MATCH       0x55
-#define CMD_ROM_SEARCH      0xf0
-#define CMD_READ_SCRATCHPAD 0xbe
-#define CMD_CONVERT_TEMP    0x44
+#define CMD_ROM_MATCH           0x55
+#define CMD_ROM_SKIP            0xcc
+#define CMD_ROM_OVERDRIVE_MATCH 0x69
+#define CMD_ROM_SEARCH          0xf0
+#define CMD_ROM_ALARM_SEARCH    0xec
+#define CMD_READ_SCRATCHPAD     0xbe
+#define CMD_WRITE_SCRATCHPAD    0x4e
+#define CMD_COPY_SCRATCHPAD     0x48
+#define CMD_RECALL_EEPROM       0xb8
+#define CMD_CONVERT_TEMP        0x44
+    
+/* Background engine configuration */
+#define ONEWIRE_QUEUE_LENGTH    8     // Maximum number of transactions waiting for the bus
+#define ONEWIRE_MAX_DATA_LEN    20    // Maximum number of bytes touched by one transaction
+#define ONEWIRE_IDLE_PERIOD_US  1000  // Engine tick period when no transaction is in progress
+    
+/* Background transaction status */
+#define ONEWIRE_TR_IDLE         0     // Transaction was never submitted
+#define ONEWIRE_TR_QUEUED       1     // Transaction is waiting for the bus or in progress
+#define ONEWIRE_TR_DONE         2     // Transaction completed, sampled data is available
+#define ONEWIRE_TR_NO_PRESENCE  3     // Reset was issued, but no device answered
+    
+/* Structures and types */
+/* Bus context. Holds pin access and speed of blocking primitives */
+typedef struct onewire_bus {
+    void  (*write)(uint8 value);    // Pin component write function
+    uint8 (*read)(void);            // Pin component read function
+    uint8 (*read_data_reg)(void);   // Pin component data register read, NULL if the component has one pin
+    uint8 mask;                     // Bit of the bus in the component value
+    uint8 speed;                    // STANDARD or OVERDRIVE
+} OneWireBus;
+
+/* Search algorithm state. Every search in progress has its own, so a search
+   advanced step by step is not disturbed by another search on the same bus */
+typedef struct onewire_search {
+    uint8         search_command;  // CMD_ROM_SEARCH or CMD_ROM_ALARM_SEARCH
+    unsigned char ROM_NO[8];
+    int           LastDiscrepancy;
+    int           LastFamilyDiscrepancy;
+    int           LastDeviceFlag;
+    unsigned char crc8;
+} OneWireSearch;
+
+/* Initializer of the bus context for single pin Pins component */
+#define ONEWIRE_BUS(pin) { .write = pin##_Write, .read = pin##_Read, .read_data_reg = NULL, .mask = 0x01, \
+                           .speed = STANDARD }
+
+/* Initializer of the bus context for line of multi-pin Pins component,
+   the line is driven by read-modify-write so the other lines keep their state */
+#define ONEWIRE_BUS_LINE(pin, line) { .write = pin##_Write, .read = pin##_Read, .read_data_reg = pin##_ReadDataReg, \
+                                      .mask = 1 << (line), .speed = STANDARD }
+
+/* Parallel (bit-sliced) port. Line n is bit n of the Pins component,
+   all lines are driven and sampled with single port write/read */
+#define ONEWIRE_PARALLEL_LINES  8     // Maximum number of lines on one port
     
-#define DEVICES_ON_BUS      2
+typedef struct onewire_parallel {
+    void  (*write)(uint8 value);   // Pins component write function, bit n drives line n
+    uint8 (*read)(void);           // Pins component read function, bit n samples line n
+    uint8 (*read_data_reg)(void);  // Pins component data register read, keeps lines out of the mask
+    uint8 lines;                   // Mask of lines in use
+} OneWireParallel;
+
+/* Initializer of the parallel port for Pins component with lines in mask */
+#define ONEWIRE_PARALLEL(pin, mask) { .write = pin##_Write, .read = pin##_Read, .read_data_reg = pin##_ReadDataReg, \
+                                      .lines = (mask) }
+
+/* Background transaction.
+   Bytes in data are touched the same way as in onewire_block():
+   write 0xff to read a byte, sampled result replaces the written byte.
+   Reset and the first byte are always at standard speed, so that overdrive
+   SKIP/MATCH ROM command can switch the rest of the transaction to overdrive. */
+typedef struct onewire_transaction {
+    OneWireBus*    bus;                         // Bus to execute the transaction on
+    uint8          data[ONEWIRE_MAX_DATA_LEN];  // Data to touch, replaced by sampled result
+    uint8          data_len;                    // Number of bytes to touch
+    uint8          reset;                       // Issue reset before touching the data
+    uint8          overdrive;                   // Touch bytes after the first one at overdrive speed
+    volatile uint8 status;                      // Transaction status, updated by the engine
+} OneWireTransaction;
+
+/* Background parallel transaction.
+   Byte i of line n is touched in data[i][n] the same way as in OneWireTransaction,
+   all lines of the transaction share the time slots. Always at standard speed. */
+typedef struct onewire_parallel_transaction {
+    OneWireParallel* port;                                             // Port to execute the transaction on
+    uint8            data[ONEWIRE_MAX_DATA_LEN][ONEWIRE_PARALLEL_LINES];  // Row i holds byte i of every line
+    uint8            data_len;                                         // Number of bytes to touch on every line
+    uint8            lines;                                            // Lines to drive, subset of the port lines
+    uint8            reset;                                            // Issue reset before touching the data
+    volatile uint8   presence;                                         // Lines that answered the reset
+    volatile uint8   status;                                           // Transaction status, updated by the engine
+} OneWireParallelTransaction;
     
 /* Functions declarations */
 /* Basic */
-void  set_speed();
-uint8 onewire_touch_reset(void);
-void  onewire_write_bit(uint8 bit);
-uint8 onewire_read_bit();
-void  onewire_write_byte(uint8 data);
-uint8 onewire_read_byte(void);
-uint8 onewire_touch_byte(uint8 data);
-void  onewire_block(unsigned char *data, int data_len);
-uint8 onewire_overdrive_skip();
+void  set_speed(OneWireBus* bus, uint8 standard);
+uint8 onewire_touch_reset(OneWireBus* bus);
+void  onewire_write_bit(OneWireBus* bus, uint8 bit);
+uint8 onewire_read_bit(OneWireBus* bus);
+void  onewire_write_byte(OneWireBus* bus, uint8 data);
+uint8 onewire_read_byte(OneWireBus* bus);
+uint8 onewire_touch_byte(OneWireBus* bus, uint8 data);
+void  onewire_block(OneWireBus* bus, unsigned char *data, int data_len);
+uint8 onewire_overdrive_match(OneWireBus* bus, uint64 rom_code);
+
+/* Background engine */
+void   onewire_engine_start();
+uint8  onewire_submit(OneWireTransaction* transaction);
+uint8  onewire_submit_parallel(OneWireParallelTransaction* transaction);
+uint8  onewire_engine_idle();
+uint32 onewire_bus_time();
+uint32 onewire_time();
 
 /* Binary search */
-int           onewire_first(uint64* buf);
-int           onewire_next(uint64* buf);
-int           onewire_search(uint64* buf);
-unsigned char docrc8(unsigned char value);
+int           onewire_first(OneWireBus* bus, OneWireSearch* search, uint64* buf);
+int           onewire_next(OneWireBus* bus, OneWireSearch* search, uint64* buf);
+int           onewire_alarm_first(OneWireBus* bus, OneWireSearch* search, uint64* buf);
+int           onewire_search(OneWireBus* bus, OneWireSearch* search, uint64* buf);
+unsigned char docrc8(OneWireSearch* search, unsigned char value);
+uint8         onewire_crc8(const uint8* data, uint8 len);
     
     
 #endif
@@ -0,0 +1,278 @@
+/* ========================================
+ *
+ * @name    Air temperature sensors interface abstraction
+ * @company Metropolia University of Applied Sciences
+ *
+ * This abstraction is built on top of I2C interface.
+ * It is meant for TC74 temperature sensor devices, all address variants (A0-A7) are supported.
+ * Datasheet: https://ww1.microchip.com/downloads/en/DeviceDoc/21462D.pdf
+ *
+ * During initialization, I2C bus is scanned for TC74 addresses and found sensors are stored in
+ * devices_on_bus structure that is later accessed by public interface functions.
+ * NUMBER_OF_AIR_TEMP_SENSORS is the capacity of the table, number of sensors is found at runtime.
+ *
+ * Readings of all sensors are queued to I2C interface, results are collected once
+ * air_temp_sensors_busy() reports false. Actuators are driven by the aggregate of the
+ * last readings configured with AIR_TEMP_AGGREGATE. Reading of a sensor that has not answered for
+ * AIR_TEMP_MAX_MISSED readouts expires and no longer contributes to the aggregate.
+ *
+ * In standby mode (AIR_TEMP_STANDBY) sensors are put to standby (SHDN) after every readout and
+ * woken by wake_air_temp_sensors() AIR_TEMP_WAKE_TIME_MS before the next one. Readout checks
+ * DATA_RDY first, temperature is read only from sensors that have completed a conversion since wake.
+ *
+ * ========================================
+*/
+
+#include "temperature_air.h"
+#include <string.h>
+
+static air_sensors_info devices_on_bus = { .count = 0, .address = { 0 }, .reading = { 0 }, .valid = { 0 }, .missed = { 0 }, .fresh = { 0 } };
+
+/* Readout phases, every phase touches planned sensors with one transaction each */
+typedef enum {
+    READOUT_IDLE,         // Results of the last readout are stored
+    READOUT_STATUS,       // Configuration register is read to check DATA_RDY
+    READOUT_TEMPERATURE,  // Temperature register is read
+    READOUT_STANDBY       // Sensors are put to standby
+} ReadoutPhase;
+
+/* Readout */
+static I2CTransaction readout_transactions[NUMBER_OF_AIR_TEMP_SENSORS];
+static I2CTransaction wake_transactions[NUMBER_OF_AIR_TEMP_SENSORS];
+static ReadoutPhase readout_phase = READOUT_IDLE;
+static uint8 planned_transactions = NUMBER_OF_AIR_TEMP_SENSORS;  // Index of the next transaction to feed
+static uint8 phase_planned[NUMBER_OF_AIR_TEMP_SENSORS];         // Sensor takes part in the current phase
+
+/*
+ * @brief Start readout phase for all sensors marked in phase_planned
+ * @param phase Phase to start
+ */
+static void start_phase(ReadoutPhase phase)
+{
+    readout_phase = phase;
+    planned_transactions = 0;
+}
+
+/*
+ * @brief  Prepare transaction of the sensor for the current phase
+ * @param  sensor_index Target sensor
+ * @return              Prepared transaction
+ */
+static I2CTransaction* prepare_transaction(uint8 sensor_index)
+{
+    I2CTransaction* transaction = &readout_transactions[sensor_index];
+    uint8 address = devices_on_bus.address[sensor_index];
+    
+    switch (readout_phase) {
+    case READOUT_STATUS:
+        i2c_prepare_register_read(transaction, address, TC74_CONFIG_REG, 1);
+        break;
+    case READOUT_STANDBY:
+        i2c_prepare_register_write(transaction, address, TC74_CONFIG_REG, TC74_CONFIG_SHDN);
+        break;
+    default:
+        i2c_prepare_register_read(transaction, address, TC74_TEMP_REG, 1);
+        break;
+    }
+    
+    return transaction;
+}
+
+/*
+ * @brief Scan I2C bus for TC74 sensors.
+ * Every TC74 address is probed with temperature register read.
+ */
+void initialize_air_temp_sensors()
+{
+    devices_on_bus.count = 0;
+    for (uint8 address = TC74_ADDRESS_FIRST; address <= TC74_ADDRESS_LAST; address++) {
+        if (devices_on_bus.count == NUMBER_OF_AIR_TEMP_SENSORS) break;
+        
+        // Absent address is NAKed
+        if (read_i2c_data(address, TC74_TEMP_REG) == I2C_ERROR) continue;
+        devices_on_bus.address[devices_on_bus.count++] = address;
+    }
+    
+#if AIR_TEMP_STANDBY
+    /* Sensors wait for the first wake in standby */
+    memset(phase_planned, 1, sizeof(phase_planned));
+    start_phase(READOUT_STANDBY);
+    while (air_temp_sensors_busy()) i2c_service();
+#endif
+}
+
+/*
+ * @brief  Get number of sensors found on the bus
+ * @return Number of sensors
+ */
+uint8 get_air_temp_sensor_count()
+{
+    return devices_on_bus.count;
+}
+
+/*
+ * @brief  Get I2C address of the sensor
+ * @param  sensor_index Target sensor
+ * @return              I2C address, 0 if the sensor does not exist
+ */
+uint8 get_air_temp_sensor_address(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    return devices_on_bus.address[sensor_index];
+}
+
+/*
+ * @brief Plan reading of all sensors.
+ * Readings are fed to I2C queue by air_temp_sensors_busy(), results are available
+ * with get_air_temperature() once the sensors are not busy.
+ */
+void plan_air_temp_readout()
+{
+    // Previous readout is still in progress
+    if (readout_phase != READOUT_IDLE) return;
+    
+    memset(phase_planned, 1, sizeof(phase_planned));
+#if AIR_TEMP_STANDBY
+    start_phase(READOUT_STATUS);
+#else
+    start_phase(READOUT_TEMPERATURE);
+#endif
+    air_temp_sensors_busy();
+}
+
+/*
+ * @brief  Check if planned readings are still in progress
+ * @return True if readings are not yet completed
+ */
+uint8 air_temp_sensors_busy()
+{
+    while (readout_phase != READOUT_IDLE) {
+        /* Feed planned transactions to I2C queue as it frees up */
+        while (planned_transactions < devices_on_bus.count) {
+            if (phase_planned[planned_transactions] && !i2c_submit(prepare_transaction(planned_transactions))) return 1;
+            planned_transactions++;
+        }
+        
+        /* Wait for all transactions of the phase */
+        for (uint8 i = 0; i < devices_on_bus.count; i++) {
+            if (phase_planned[i] && readout_transactions[i].status == I2C_TR_QUEUED) return 1;
+        }
+        
+        /* Complete the phase and start the next one */
+        switch (readout_phase) {
+        case READOUT_STATUS:
+            // Skip sensors without new conversion
+            for (uint8 i = 0; i < devices_on_bus.count; i++) {
+                phase_planned[i] = readout_transactions[i].status == I2C_TR_DONE &&
+                                   (readout_transactions[i].read_data[0] & TC74_CONFIG_DATA_RDY);
+            }
+            start_phase(READOUT_TEMPERATURE);
+            break;
+            
+        case READOUT_TEMPERATURE:
+            /* Store results */
+            for (uint8 i = 0; i < devices_on_bus.count; i++) {
+                devices_on_bus.fresh[i] = phase_planned[i] && readout_transactions[i].status == I2C_TR_DONE;
+                if (devices_on_bus.fresh[i]) {
+                    devices_on_bus.reading[i] = (int8)readout_transactions[i].read_data[0];  // Two's complement
+                    devices_on_bus.valid[i]   = 1;
+                    devices_on_bus.missed[i]  = 0;
+                }
+                // Sensor stopped answering, do not drive actuators by its old reading
+                else if (devices_on_bus.valid[i] && ++devices_on_bus.missed[i] >= AIR_TEMP_MAX_MISSED) {
+                    devices_on_bus.valid[i] = 0;
+                }
+            }
+#if AIR_TEMP_STANDBY
+            memset(phase_planned, 1, sizeof(phase_planned));
+            start_phase(READOUT_STANDBY);
+#else
+            readout_phase = READOUT_IDLE;
+#endif
+            break;
+            
+        default:
+            readout_phase = READOUT_IDLE;
+            break;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * @brief  Get temperature obtained by the last readout
+ * @param  sensor_index Sensor to get the reading of
+ * @param  temperature  Temperature value in C, left untouched on failure
+ * @return              True if the sensor was read by the last readout
+ */
+uint8 get_air_temperature(uint8 sensor_index, int16* temperature)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    if (!devices_on_bus.fresh[sensor_index]) return 0;
+    
+    *temperature = devices_on_bus.reading[sensor_index];
+    return 1;
+}
+
+/*
+ * @brief  Get aggregate of the last readings that have not expired, configured with AIR_TEMP_AGGREGATE
+ * @param  temperature Temperature value in C, left untouched on failure
+ * @return             True if at least one reading contributed to the aggregate
+ */
+uint8 get_aggregate_air_temperature(int16* temperature)
+{
+#if AIR_TEMP_AGGREGATE == AIR_TEMP_AGGREGATE_SENSOR
+    if (AIR_TEMP_CHOSEN_SENSOR >= devices_on_bus.count || !devices_on_bus.valid[AIR_TEMP_CHOSEN_SENSOR]) return 0;
+    
+    *temperature = devices_on_bus.reading[AIR_TEMP_CHOSEN_SENSOR];
+    return 1;
+#else
+    int16 result = 0;
+    uint8 contributed = 0;
+    
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        if (!devices_on_bus.valid[i]) continue;
+        int16 reading = devices_on_bus.reading[i];
+        
+    #if AIR_TEMP_AGGREGATE == AIR_TEMP_AGGREGATE_MAX
+        if (!contributed || reading > result) result = reading;
+    #elif AIR_TEMP_AGGREGATE == AIR_TEMP_AGGREGATE_MIN
+        if (!contributed || reading < result) result = reading;
+    #else
+        result += reading;
+    #endif
+        contributed++;
+    }
+    if (!contributed) return 0;
+    
+    #if AIR_TEMP_AGGREGATE == AIR_TEMP_AGGREGATE_MEAN
+    result /= contributed;
+    #endif
+    
+    *temperature = result;
+    return 1;
+#endif
+}
+
+/*
+ * @brief Wake all sensors from standby.
+ * Call AIR_TEMP_WAKE_TIME_MS before the readout, so that fresh conversion is ready.
+ */
+void wake_air_temp_sensors()
+{
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        I2CTransaction* transaction = &wake_transactions[i];
+        
+        // Previous wake is still queued
+        if (transaction->status == I2C_TR_QUEUED) continue;
+        
+        i2c_prepare_register_write(transaction, devices_on_bus.address[i], TC74_CONFIG_REG, 0x00);
+        while (!i2c_submit(transaction)) i2c_service();
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,75 @@
+/* ========================================
+ *
+ * @name    Air temperature sensors interface abstraction
+ * @company Metropolia University of Applied Sciences
+ *
+ * This abstraction is built on top of I2C interface.
+ * It is meant for TC74 temperature sensor devices, all address variants (A0-A7) are supported.
+ * Datasheet: https://ww1.microchip.com/downloads/en/DeviceDoc/21462D.pdf
+ *
+ * During initialization, I2C bus is scanned for TC74 addresses and found sensors are stored in
+ * devices_on_bus structure that is later accessed by public interface functions.
+ * NUMBER_OF_AIR_TEMP_SENSORS is the capacity of the table, number of sensors is found at runtime.
+ *
+ * Readings of all sensors are queued to I2C interface, results are collected once
+ * air_temp_sensors_busy() reports false. Actuators are driven by the aggregate of the
+ * last readings configured with AIR_TEMP_AGGREGATE. Reading of a sensor that has not answered for
+ * AIR_TEMP_MAX_MISSED readouts expires and no longer contributes to the aggregate.
+ *
+ * In standby mode (AIR_TEMP_STANDBY) sensors are put to standby (SHDN) after every readout and
+ * woken by wake_air_temp_sensors() AIR_TEMP_WAKE_TIME_MS before the next one. Readout checks
+ * DATA_RDY first, temperature is read only from sensors that have completed a conversion since wake.
+ *
+ * ========================================
+*/
+
+#ifndef TEMPERATURE_AIR_H
+#define TEMPERATURE_AIR_H
+
+    
+#include "i2c_driver.h"
+    
+#define NUMBER_OF_AIR_TEMP_SENSORS 4  // Capacity of the sensor table, maximum number of sensors
+
+#define TC74_ADDRESS_FIRST  0x48  // I2C address of TC74A0
+#define TC74_ADDRESS_LAST   0x4f  // I2C address of TC74A7
+#define TC74_TEMP_REG       0x00  // Temperature register of the sensor
+#define TC74_CONFIG_REG     0x01  // Configuration register of the sensor
+#define TC74_CONFIG_SHDN    0x80  // Standby switch, read/write
+#define TC74_CONFIG_DATA_RDY 0x40 // Conversion completed since power up or wake, read only
+
+#define AIR_TEMP_STANDBY       1    // Keep sensors in standby between readouts
+#define AIR_TEMP_WAKE_TIME_MS  300  // Wake lead time, first conversion takes up to 250 ms (4 samples/s)
+#define AIR_TEMP_MAX_MISSED    3    // Readouts without fresh reading before the last reading expires
+
+/* Aggregate of the sensors used by actuators */
+#define AIR_TEMP_AGGREGATE_MEAN    0  // Mean of all valid readings
+#define AIR_TEMP_AGGREGATE_MAX     1  // Hottest valid reading
+#define AIR_TEMP_AGGREGATE_MIN     2  // Coldest valid reading
+#define AIR_TEMP_AGGREGATE_SENSOR  3  // Reading of AIR_TEMP_CHOSEN_SENSOR
+
+#define AIR_TEMP_AGGREGATE      AIR_TEMP_AGGREGATE_MEAN
+#define AIR_TEMP_CHOSEN_SENSOR  0  // Sensor index used by AIR_TEMP_AGGREGATE_SENSOR
+
+/* Structures and types */
+typedef struct air_sensors_information {
+    uint8 count;                                 // Number of sensors found on the bus
+    uint8 address[NUMBER_OF_AIR_TEMP_SENSORS];   // I2C address of the sensor
+    int16 reading[NUMBER_OF_AIR_TEMP_SENSORS];   // Last valid reading, C
+    uint8 valid[NUMBER_OF_AIR_TEMP_SENSORS];     // Last reading has not expired
+    uint8 missed[NUMBER_OF_AIR_TEMP_SENSORS];    // Readouts without fresh reading since the last one
+    uint8 fresh[NUMBER_OF_AIR_TEMP_SENSORS];     // Reading was updated by the last readout
+} air_sensors_info;
+
+/* Function declarations */
+void  initialize_air_temp_sensors();
+uint8 get_air_temp_sensor_count();
+uint8 get_air_temp_sensor_address(uint8 sensor_index);
+void  plan_air_temp_readout();
+uint8 air_temp_sensors_busy();
+uint8 get_air_temperature(uint8 sensor_index, int16* temperature);
+uint8 get_aggregate_air_temperature(int16* temperature);
+void  wake_air_temp_sensors();
+    
+
+#endif /* [] END OF FILE */
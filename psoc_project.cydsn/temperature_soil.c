@@ -11,98 +11,1048 @@
  * Datasheet: https://datasheets.maximintegrated.com/en/ds/DS18B20.pdf
  *
  * During initialization, all the sensor found on the bus are stored in
- * devices_on_bus structure that is later accessed by public interface functions.
- * To alter number of sensor present on OneWire bus, change NUMBER_OF_SOIL_TEMP_SENSORS parameter.
+ * devices_on_bus structure (ROM table) that is later accessed by public interface functions.
+ * NUMBER_OF_SOIL_TEMP_SENSORS is the capacity of the table, number of sensors is found at runtime.
+ * The table is cached in EEPROM, so binary search is skipped at boot when the cache is valid.
+ * Buses are rescanned in background one device at a time, added or removed sensors
+ * update the table and the cache.
+ *
+ * Sensors can be split over several OneWire buses, each bus keeps its own chain of sensors.
+ * Buses are listed in soil_temp_buses, sensors are enumerated bus by bus.
+ *
+ * Conversion and reading can be queued to OneWire background engine instead of
+ * being executed inline. Queued results are collected once soil_temp_sensors_busy() reports false.
+ *
+ * Every device is probed for overdrive support during initialization. Overdrive capable devices
+ * are addressed with OVERDRIVE MATCH ROM by the queued interface, the rest stays at standard speed.
+ *
+ * Resolution of every sensor (9-12 bits) can be configured to trade precision for conversion time.
+ * The conversion is waited for the slowest configured sensor. New resolution is written by
+ * plan_soil_temp_conversion() before it starts the next conversion, so scratchpad writes and
+ * COPY SCRATCHPAD never interleave with a conversion or its status polling. TH/TL are recalled
+ * from sensor's EEPROM first, so alarm band of the alarm readout is not copied to EEPROM.
+ *
+ * In alarm readout mode (SOIL_TEMP_ALARM_READOUT) TH/TL of every sensor are written to the scratchpad
+ * SOIL_TEMP_ALARM_BAND degrees around the integer part of the last reading. Broadcast conversion sets
+ * the alarm flag of sensors that left their band, the readout reads only sensors found by ALARM SEARCH.
+ * The search is advanced one device at a time between the polls of the readout, like the rescan.
+ * Changes within the same integer degree are picked up by full readout every SOIL_TEMP_ALARM_REFRESH_PERIOD cycle,
+ * so they reach the filters at most SOIL_TEMP_ALARM_REFRESH_PERIOD cycles (plus a profiling cycle) late.
+ *
+ * Every reading fetches the full scratchpad and validates it with CRC. All-zero scratchpad (bus shorted)
+ * and power-on temperature (85 C) are rejected as well. Failed readings are retried SOIL_TEMP_READ_RETRIES
+ * times, queued retries are limited by SOIL_TEMP_RETRY_BUDGET_US. Failures are reported to the caller
+ * and counted per sensor.
+ *
+ * Transaction planner organizes the bus cycle: conversion is started on all sensors at once
+ * with a single SKIP ROM command, readings of all sensors are fed to the engine as one sequence.
+ * Bus time spent by the last planned cycle is tracked for diagnostics.
+ * With SOIL_TEMP_PARALLEL_BUSES conversion and readout are issued on all buses in lockstep
+ * by parallel transactions, one sensor of every bus per readout transaction.
+ *
+ * In adaptive mode (SOIL_TEMP_ADAPTIVE_CONVERSION) the planner polls conversion status with read
+ * time slots right after CONVERT T. Slots are wired-AND on the bus, so the readout can start as soon
+ * as the slowest sensor has finished. Conversion time of individual sensors can not be observed
+ * on broadcast conversion, thus every SOIL_TEMP_PROFILE_PERIOD cycle converts and reads a single
+ * sensor (round robin) with MATCH ROM to measure its time. Polling requires external power supply of the sensors.
  *
  * ========================================
 */
 
 #include "temperature_soil.h"
+#include "eeprom_layout.h"
+
+#if SOIL_TEMP_PARALLEL_BUSES
+/* OneWire buses are lines of one Pins component, add ONEWIRE_BUS_LINE(<Pins component>, <line>) for every additional line */
+static OneWireBus soil_temp_buses[NUMBER_OF_SOIL_TEMP_BUSES] = {
+    ONEWIRE_BUS_LINE(OneWire_Pin, 0)
+};
+static OneWireParallel soil_temp_port = ONEWIRE_PARALLEL(OneWire_Pin, (1 << NUMBER_OF_SOIL_TEMP_BUSES) - 1);
+#else
+/* OneWire buses, add ONEWIRE_BUS(<Pins component>) for every additional bus */
+static OneWireBus soil_temp_buses[NUMBER_OF_SOIL_TEMP_BUSES] = {
+    ONEWIRE_BUS(OneWire_Pin)
+};
+#endif
+
+static slaves_info devices_on_bus = { .count = 0, .rom_codes = { 0 }, .bus = { 0 }, .overdrive = { 0 }, .conversion_time = { 0 }, .resolution = { 0 } };
 
-static slaves_info devices_on_bus = { .rom_codes = { 0 } };
+/* Transactions used by the queued interface, one set per sensor */
+static OneWireTransaction conversion_transactions[NUMBER_OF_SOIL_TEMP_SENSORS];
+static OneWireTransaction reading_transactions[NUMBER_OF_SOIL_TEMP_SENSORS];
+static OneWireTransaction alarm_transactions[NUMBER_OF_SOIL_TEMP_SENSORS];
+
+/* Transaction planner */
+#if SOIL_TEMP_PARALLEL_BUSES
+static OneWireParallelTransaction parallel_conversion;
+#else
+static OneWireTransaction broadcast_conversion[NUMBER_OF_SOIL_TEMP_BUSES];
+#endif
+static OneWireTransaction conversion_poll[NUMBER_OF_SOIL_TEMP_BUSES];
+static uint8  bus_converting[NUMBER_OF_SOIL_TEMP_BUSES];  // Conversion on the bus is not yet finished
+static uint8  planned_readings     = NUMBER_OF_SOIL_TEMP_SENSORS;  // Index of the next reading to feed
+static uint8  planned_readings_end = NUMBER_OF_SOIL_TEMP_SENSORS;  // Index after the last reading to feed
+static uint8  reading_planned[NUMBER_OF_SOIL_TEMP_SENSORS];        // Sensor is read in this cycle
+static uint8  last_cycle_readings  = 0;  // Number of sensors read in the last cycle
+static uint8  readouts_since_refresh = 0;  // Alarm driven readouts since the last full readout
+static uint32 readout_start        = 0;  // Time at the start of the readout, us
+static uint8  alarm_search_active  = 0;  // ALARM SEARCH of the readout is in progress
+static uint8  alarm_search_first   = 1;  // Next search on the bus starts from the first device
+static uint8  alarm_search_bus     = 0;  // Bus being searched
+static OneWireSearch alarm_search;       // Search state of the readout, apart from the rescan
+#if SOIL_TEMP_PARALLEL_BUSES
+static OneWireParallelTransaction parallel_reading;
+static uint8 parallel_reading_sensor[ONEWIRE_PARALLEL_LINES];  // Sensor read on the line by parallel_reading
+static uint8 reading_fed[NUMBER_OF_SOIL_TEMP_SENSORS];         // Sensor was read by parallel_reading in this cycle
+#endif
+
+/* Validated readings */
+typedef enum {
+    READING_NONE,     // Sensor was never read successfully
+    READING_PENDING,  // Reading is queued or being retried
+    READING_VALID,    // Last reading passed validation
+    READING_FAILED    // Last reading failed after all retries
+} ReadingState;
+
+static ReadingState reading_state[NUMBER_OF_SOIL_TEMP_SENSORS];
+static uint8        reading_retries[NUMBER_OF_SOIL_TEMP_SENSORS];  // Retries spent on the current reading
+static int16        last_raw[NUMBER_OF_SOIL_TEMP_SENSORS];         // Temperature register of the last valid reading
+static uint8  cycle_in_progress    = 0;  // Planned cycle is not yet completed
+static uint32 cycle_start_time     = 0;  // Bus time at the beginning of the cycle
+static uint32 last_cycle_bus_time  = 0;  // Bus time spent by the last completed cycle, us
+static uint8  cycle_number         = 0;  // Number of planned cycles, used to schedule profiling
+static uint8  profiled_sensor      = NUMBER_OF_SOIL_TEMP_SENSORS;  // Sensor converted alone in this cycle
+static uint32 conversion_start     = 0;  // Time at the start of the conversion, us
+static uint32 last_poll_time       = 0;  // Time of the last conversion status poll, us
+static uint16 last_conversion_time = 0;  // Observed conversion time of the last cycle, ms
+
+/* Background rescan */
+static uint64 rescan_rom_codes[NUMBER_OF_SOIL_TEMP_SENSORS];
+static uint8  rescan_buses[NUMBER_OF_SOIL_TEMP_SENSORS];
+static uint8  rescan_active = 0;  // Rescan is in progress
+static uint8  rescan_first  = 1;  // Next search on the bus starts from the first device
+static uint8  rescan_bus    = 0;  // Bus being scanned
+static uint8  rescan_count  = 0;  // Number of devices found by the rescan so far
+static OneWireSearch rescan_search;  // Search state of the rescan, apart from the readout
 
 /*
- * @brief Identify sensors present on the bus
- * NUMBER_OF_SENSORS configures number of sensors on the device
+ * @brief  Get the bus the sensor is connected to
+ * @param  sensor_index Target sensor
+ * @return              Bus context
  */
-void initialize_soil_temp_sensors()
+static OneWireBus* sensor_bus(uint8 sensor_index)
 {
-    set_speed();
+    return &soil_temp_buses[devices_on_bus.bus[sensor_index]];
+}
+
+/*
+ * @brief Start transaction with match ROM command and the device address.
+ * Overdrive capable devices are matched with overdrive match ROM,
+ * the rest of the transaction is then touched at overdrive speed.
+ * @param transaction  Target transaction
+ * @param sensor_index Sensor to address
+ */
+static void put_match_rom(OneWireTransaction* transaction, uint8 sensor_index)
+{
+    uint8 overdrive = devices_on_bus.overdrive[sensor_index];
     
-    /* Read devices' ROM codes */
-    /* After initialization ROM codes can be accessed from devices_on_bus in private interface */
-    onewire_first(&devices_on_bus.rom_codes[0]);
-    for (uint8_t i = 1; i < NUMBER_OF_SOIL_TEMP_SENSORS; i++) {
-        onewire_next(&devices_on_bus.rom_codes[i]);    
+    transaction->bus       = sensor_bus(sensor_index);
+    transaction->reset     = 1;
+    transaction->overdrive = overdrive;
+    transaction->data[0]   = overdrive ? CMD_ROM_OVERDRIVE_MATCH : CMD_ROM_MATCH;
+    /* LSB->MSB device address */
+    for (uint8_t i = 0; i < 8; i++) {
+        transaction->data[i + 1] = devices_on_bus.rom_codes[sensor_index] >> (BYTE_LEN * i);
     }
+    transaction->data_len = 9;
 }
 
 /*
- * @brief  Get reading of temperature
- * @param  sensor_index Sensor to read from
- * @return              Temperature value
+ * @brief  Address the sensor with blocking primitives.
+ * Waits until queued transactions are completed.
+ * @param  sensor_index Sensor to address
+ * @return              True if presence was detected
  */
-float get_soil_temperature(uint8 sensor_index)
+static uint8 select_sensor(uint8 sensor_index)
 {
-    // Sanity check
-    if (sensor_index > NUMBER_OF_SOIL_TEMP_SENSORS - 1) return 0;
+    // Blocking access must not interfere with queued transactions
+    while (soil_temp_sensors_busy());
     
-    set_speed();
+    OneWireBus* bus = sensor_bus(sensor_index);
+    set_speed(bus, STANDARD);
     
     // Detect presence
-    if (onewire_touch_reset()) return 0;
+    if (onewire_touch_reset(bus)) return 0;
     
     /* Issue match ROM command and write the device address */
-    onewire_write_byte(CMD_ROM_MATCH);
+    onewire_write_byte(bus, CMD_ROM_MATCH);
     /* LSB->MSB device address */
     for (uint8_t i = 0; i < 8; i++) {
         uint8_t to_send = devices_on_bus.rom_codes[sensor_index] >> (BYTE_LEN * i);
-        onewire_write_byte(to_send);
+        onewire_write_byte(bus, to_send);
+    }
+    
+    return 1;
+}
+
+/*
+ * @brief  Validate scratchpad read from the sensor.
+ * All-zero scratchpad passes CRC, it is rejected explicitly. Power-on temperature is
+ * rejected only for readings taken after a conversion, before the first conversion
+ * the sensor holds it legitimately.
+ * @param  sensor_index   Sensor the scratchpad was read from
+ * @param  scratchpad     Scratchpad, SCRATCHPAD_LEN bytes long
+ * @param  check_power_on True if the scratchpad was read after a conversion
+ * @return                True if the scratchpad is valid
+ */
+static uint8 scratchpad_valid(uint8 sensor_index, const uint8* scratchpad, uint8 check_power_on)
+{
+    uint8 all_zero = 1;
+    for (uint8 i = 0; i < SCRATCHPAD_LEN; i++) {
+        if (scratchpad[i]) all_zero = 0;
+    }
+    if (all_zero) return 0;
+    
+    // CRC over the whole scratchpad including CRC byte is zero
+    if (onewire_crc8(scratchpad, SCRATCHPAD_LEN)) return 0;
+    if (!check_power_on) return 1;
+    
+    uint16 raw = (scratchpad[SCRATCHPAD_TEMP_MSB] << 8) | scratchpad[SCRATCHPAD_TEMP_LSB];
+    return raw != SCRATCHPAD_POWER_ON_TEMP;
+}
+
+/*
+ * @brief  Read and validate the scratchpad of the sensor with blocking primitives.
+ * Reading is retried SOIL_TEMP_READ_RETRIES times. Used for configuration reads,
+ * temperature register is not checked since no conversion may have been done yet.
+ * @param  sensor_index Sensor to read from
+ * @param  scratchpad   Target buffer, SCRATCHPAD_LEN bytes long
+ * @return              True if valid scratchpad was read
+ */
+static uint8 read_scratchpad(uint8 sensor_index, uint8* scratchpad)
+{
+    for (uint8 attempt = 0; attempt <= SOIL_TEMP_READ_RETRIES; attempt++) {
+        if (select_sensor(sensor_index)) {
+            onewire_write_byte(sensor_bus(sensor_index), CMD_READ_SCRATCHPAD);
+            memset(scratchpad, 0xff, SCRATCHPAD_LEN);
+            onewire_block(sensor_bus(sensor_index), scratchpad, SCRATCHPAD_LEN);
+            
+            if (scratchpad_valid(sensor_index, scratchpad, 0)) return 1;
+        }
+        devices_on_bus.read_errors[sensor_index]++;
+    }
+    
+    devices_on_bus.read_failures[sensor_index]++;
+    return 0;
+}
+
+/*
+ * @brief  Convert scratchpad temperature register to fixed point.
+ * The register is two's complement in 1/16 C, bits below configured resolution are undefined.
+ * @param  sensor_index Sensor the register was read from
+ * @param  lsb          Temperature LSB
+ * @param  msb          Temperature MSB
+ * @return              Temperature value, 1/16 C
+ */
+static int16 decode_temperature(uint8 sensor_index, uint8 lsb, uint8 msb)
+{
+    int16 raw = (int16)((msb << 8) | lsb);
+    uint8 undefined_bits = SOIL_TEMP_RESOLUTION_MAX - devices_on_bus.resolution[sensor_index];
+    
+    return raw & ~((1 << undefined_bits) - 1);
+}
+
+/*
+ * @brief  Check CRC of the ROM code
+ * @param  rom_code Device address
+ * @return          True if CRC byte matches
+ */
+static uint8 rom_code_valid(uint64 rom_code)
+{
+    uint8 bytes[8];
+    for (uint8 i = 0; i < 8; i++) {
+        bytes[i] = rom_code >> (BYTE_LEN * i);
+    }
+    
+    // CRC over the whole ROM code including CRC byte is zero
+    return onewire_crc8(bytes, 8) == 0;
+}
+
+/*
+ * @brief  Load ROM table from EEPROM cache
+ * @return True if the cache was valid
+ */
+static uint8 load_rom_table()
+{
+    uint16 address = SOIL_TEMP_ROM_TABLE_ADDR;
+    
+    if (EEPROM_ReadByte(address++) != SOIL_TEMP_ROM_TABLE_MAGIC) return 0;
+    uint8 count = EEPROM_ReadByte(address++);
+    if (count == 0 || count > NUMBER_OF_SOIL_TEMP_SENSORS) return 0;
+    
+    for (uint8 i = 0; i < count; i++) {
+        uint64 rom_code = 0;
+        for (uint8 j = 0; j < 8; j++) {
+            rom_code |= (uint64)EEPROM_ReadByte(address++) << (BYTE_LEN * j);
+        }
+        uint8 bus = EEPROM_ReadByte(address++);
+        
+        if (bus >= NUMBER_OF_SOIL_TEMP_BUSES || !rom_code_valid(rom_code)) return 0;
+        devices_on_bus.rom_codes[i] = rom_code;
+        devices_on_bus.bus[i]       = bus;
+    }
+    
+    devices_on_bus.count = count;
+    return 1;
+}
+
+/*
+ * @brief Save ROM table to EEPROM cache.
+ * Table is written by rows, rows already holding it are skipped to reduce EEPROM wear.
+ */
+static void save_rom_table()
+{
+    uint8 table[SOIL_TEMP_ROM_TABLE_SIZE] = { SOIL_TEMP_ROM_TABLE_MAGIC, devices_on_bus.count };
+    
+    uint8 idx = 2;
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        for (uint8 j = 0; j < 8; j++) {
+            table[idx++] = devices_on_bus.rom_codes[i] >> (BYTE_LEN * j);
+        }
+        table[idx++] = devices_on_bus.bus[i];
+    }
+    
+    write_eeprom_block(SOIL_TEMP_ROM_TABLE_ADDR, table, idx, NULL);
+}
+
+/*
+ * @brief  Enumerate all devices on all buses with binary search
+ * @param  rom_codes Found ROM codes
+ * @param  buses     Bus index of found devices
+ * @return           Number of devices found, limited by NUMBER_OF_SOIL_TEMP_SENSORS
+ */
+static uint8 enumerate_buses(uint64* rom_codes, uint8* buses)
+{
+    uint8 count = 0;
+    for (uint8 b = 0; b < NUMBER_OF_SOIL_TEMP_BUSES && count < NUMBER_OF_SOIL_TEMP_SENSORS; b++) {
+        OneWireBus* bus = &soil_temp_buses[b];
+        OneWireSearch search;
+        set_speed(bus, STANDARD);
+        
+        int found = onewire_first(bus, &search, &rom_codes[count]);
+        while (found && count < NUMBER_OF_SOIL_TEMP_SENSORS) {
+            buses[count++] = b;
+            if (count == NUMBER_OF_SOIL_TEMP_SENSORS) break;
+            found = onewire_next(bus, &search, &rom_codes[count]);
+        }
+    }
+    
+    return count;
+}
+
+/*
+ * @brief Negotiate speed and obtain resolution of all devices in the ROM table
+ */
+static void configure_sensors()
+{
+    /* Negotiate speed with every device */
+    for (uint8_t i = 0; i < devices_on_bus.count; i++) {
+        devices_on_bus.overdrive[i] = onewire_overdrive_match(sensor_bus(i), devices_on_bus.rom_codes[i]);
+    }
+    // Standard speed reset returns all devices to standard speed
+    for (uint8 b = 0; b < NUMBER_OF_SOIL_TEMP_BUSES; b++) {
+        set_speed(&soil_temp_buses[b], STANDARD);
+        onewire_touch_reset(&soil_temp_buses[b]);
+    }
+    
+    /* Obtain resolution stored in devices' EEPROM */
+    for (uint8_t i = 0; i < devices_on_bus.count; i++) {
+        uint8 scratchpad[SCRATCHPAD_LEN];
+        devices_on_bus.resolution[i] = SOIL_TEMP_RESOLUTION_MAX;
+        devices_on_bus.conversion_time[i] = 0;
+        devices_on_bus.alarm_set[i] = 0;
+        devices_on_bus.pending_resolution[i] = 0;
+        reading_state[i] = READING_NONE;
+        if (read_scratchpad(i, scratchpad)) {
+            devices_on_bus.resolution[i] = SOIL_TEMP_RESOLUTION_MIN + ((scratchpad[SCRATCHPAD_CONFIG] >> 5) & 0x03);
+        }
+    }
+}
+
+/*
+ * @brief Identify sensors present on the bus.
+ * ROM table is loaded from EEPROM cache if it is valid, otherwise buses are enumerated.
+ * Cached table is verified by background rescan.
+ */
+void initialize_soil_temp_sensors()
+{
+    /* After initialization ROM codes can be accessed from devices_on_bus in private interface */
+    if (load_rom_table()) {
+        start_soil_temp_rescan();
+    }
+    else {
+        devices_on_bus.count = enumerate_buses(devices_on_bus.rom_codes, devices_on_bus.bus);
+        save_rom_table();
+    }
+    
+    configure_sensors();
+    
+    /* Queued interface is served by the background engine from now on */
+    onewire_engine_start();
+}
+
+/*
+ * @brief  Queue DS1822 conversion to the background engine
+ * @param  sensor_index Sensor to start conversion on
+ * @return              True if the conversion was queued
+ */
+uint8 queue_conversion_soil_temp_sensor(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    OneWireTransaction* transaction = &conversion_transactions[sensor_index];
+    
+    /* Reset | MATCH ROM | ADDRESS | CONVERT */
+    put_match_rom(transaction, sensor_index);
+    transaction->data[transaction->data_len++] = CMD_CONVERT_TEMP;
+    
+    return onewire_submit(transaction);
+}
+
+/*
+ * @brief  Queue reading of temperature to the background engine.
+ * Result is available with get_queued_soil_temperature() once the sensors are not busy.
+ * @param  sensor_index Sensor to read from
+ * @return              True if the reading was queued
+ */
+uint8 queue_reading_soil_temp_sensor(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    OneWireTransaction* transaction = &reading_transactions[sensor_index];
+    
+    /* Reset | MATCH ROM | ADDRESS | READ SCRATCHPAD | SCRATCHPAD[9] */
+    put_match_rom(transaction, sensor_index);
+    transaction->data[transaction->data_len++] = CMD_READ_SCRATCHPAD;
+    memset(&transaction->data[transaction->data_len], 0xff, SCRATCHPAD_LEN);
+    transaction->data_len += SCRATCHPAD_LEN;
+    
+    return onewire_submit(transaction);
+}
+
+static uint8 alarm_search_step();
+static void  start_planned_readings();
+
+#if SOIL_TEMP_PARALLEL_BUSES
+/*
+ * @brief  Feed planned readings to the engine as parallel transactions.
+ * Every transaction reads the next planned sensor of every bus at once. Results are handed
+ * over to the reading transactions of the sensors, so they are validated and retried as usual.
+ * @return True once all planned readings are completed
+ */
+static uint8 feed_parallel_readings()
+{
+    OneWireParallelTransaction* transaction = &parallel_reading;
+    if (transaction->status == ONEWIRE_TR_QUEUED) return 0;
+    
+    /* Hand the results over, as if the sensors were read one by one */
+    for (uint8 line = 0; line < ONEWIRE_PARALLEL_LINES && transaction->status != ONEWIRE_TR_IDLE; line++) {
+        if (!(transaction->lines & (1 << line))) continue;
+        
+        OneWireTransaction* reading = &reading_transactions[parallel_reading_sensor[line]];
+        for (uint8 i = 0; i < transaction->data_len; i++) {
+            reading->data[i] = transaction->data[i][line];
+        }
+        reading->data_len = transaction->data_len;
+        reading->status   = (transaction->presence & (1 << line)) ? ONEWIRE_TR_DONE : ONEWIRE_TR_NO_PRESENCE;
     }
+    transaction->status = ONEWIRE_TR_IDLE;
     
-    // Initiate reading
-    onewire_write_byte(CMD_READ_SCRATCHPAD);
+    /* Reset | MATCH ROM | ADDRESS | READ SCRATCHPAD | SCRATCHPAD[9], next planned sensor of every bus */
+    transaction->lines = 0;
+    for (uint8 i = planned_readings; i < planned_readings_end; i++) {
+        uint8 line = devices_on_bus.bus[i];
+        if (!reading_planned[i] || reading_fed[i] || (transaction->lines & (1 << line))) continue;
+        
+        transaction->data[0][line] = CMD_ROM_MATCH;
+        /* LSB->MSB device address */
+        for (uint8 j = 0; j < 8; j++) {
+            transaction->data[j + 1][line] = devices_on_bus.rom_codes[i] >> (BYTE_LEN * j);
+        }
+        transaction->data[9][line] = CMD_READ_SCRATCHPAD;
+        for (uint8 j = 0; j < SCRATCHPAD_LEN; j++) {
+            transaction->data[10 + j][line] = 0xff;
+        }
+        
+        parallel_reading_sensor[line] = i;
+        transaction->lines |= 1 << line;
+    }
+    if (!transaction->lines) return 1;
     
-    // Read LSB and MSB from the scratchpad
-    uint8 lsb = onewire_read_byte();
-    uint8 msb = onewire_read_byte();
+    transaction->port     = &soil_temp_port;
+    transaction->reset    = 1;
+    transaction->data_len = 10 + SCRATCHPAD_LEN;
     
-    // Initiate reset to terminate reading
-    onewire_touch_reset();
+    // Queue is full, the same readings are built again on the next call
+    if (!onewire_submit_parallel(transaction)) return 0;
+    
+    for (uint8 line = 0; line < ONEWIRE_PARALLEL_LINES; line++) {
+        if (transaction->lines & (1 << line)) reading_fed[parallel_reading_sensor[line]] = 1;
+    }
+    return 0;
+}
+#endif
+
+/*
+ * @brief  Check if queued conversions or readings are still in progress
+ * @return True if OneWire bus is busy
+ */
+uint8 soil_temp_sensors_busy()
+{
+    /* Readings are planned once ALARM SEARCH has passed all buses */
+    if (alarm_search_active) {
+        if (!alarm_search_step()) return 1;
+        start_planned_readings();
+    }
+    
+#if SOIL_TEMP_PARALLEL_BUSES
+    if (!feed_parallel_readings()) return 1;
+#else
+    /* Feed planned readings to the engine as the queue frees up */
+    while (planned_readings < planned_readings_end) {
+        if (reading_planned[planned_readings] && !queue_reading_soil_temp_sensor(planned_readings)) return 1;
+        planned_readings++;
+    }
+#endif
+    
+    if (!onewire_engine_idle()) return 1;
+    
+    /* Validate completed readings, retry the failed ones */
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        if (reading_state[i] != READING_PENDING) continue;
+        
+        OneWireTransaction* transaction = &reading_transactions[i];
+        const uint8* scratchpad = &transaction->data[transaction->data_len - SCRATCHPAD_LEN];
+        if (transaction->status == ONEWIRE_TR_DONE && scratchpad_valid(i, scratchpad, 1)) {
+            last_raw[i] = (int16)((scratchpad[SCRATCHPAD_TEMP_MSB] << 8) | scratchpad[SCRATCHPAD_TEMP_LSB]);
+            reading_state[i] = READING_VALID;
+            continue;
+        }
+        
+        devices_on_bus.read_errors[i]++;
+        if (reading_retries[i] < SOIL_TEMP_READ_RETRIES && onewire_time() - readout_start < SOIL_TEMP_RETRY_BUDGET_US) {
+            reading_retries[i]++;
+            queue_reading_soil_temp_sensor(i);
+            return 1;
+        }
+        
+        devices_on_bus.read_failures[i]++;
+        reading_state[i] = READING_FAILED;
+    }
+    
+    /* Planned cycle is completed */
+    if (cycle_in_progress) {
+        last_cycle_bus_time = onewire_bus_time() - cycle_start_time;
+        cycle_in_progress = 0;
+    }
+    
+    return 0;
+}
+
+/*
+ * @brief  Get temperature obtained by the last queued reading.
+ * Sensors that were not read in the cycle keep the previous valid reading.
+ * @param  sensor_index Sensor to get the reading of
+ * @param  temperature  Temperature value, left untouched on failure
+ * @return              True if the last reading is valid
+ */
+uint8 get_queued_soil_temperature(uint8 sensor_index, int16* temperature)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    if (reading_state[sensor_index] != READING_VALID) return 0;
+    
+    *temperature = decode_temperature(sensor_index, last_raw[sensor_index] & 0xff, last_raw[sensor_index] >> 8);
+    return 1;
+}
+
+#if SOIL_TEMP_ALARM_READOUT
+/*
+ * @brief Queue programming of the alarm band around the last reading of the sensor.
+ * TH/TL are written to the scratchpad only, sensor's EEPROM is not worn.
+ * Nothing is queued if the band has not moved. If the queue is full,
+ * the band is left as is and is moved in the next cycle.
+ * @param sensor_index Target sensor
+ */
+static void queue_alarm_band(uint8 sensor_index)
+{
+    if (reading_state[sensor_index] != READING_VALID) return;
+    if (alarm_transactions[sensor_index].status == ONEWIRE_TR_QUEUED) return;
+    
+    // Integer part of the temperature, rounded down
+    int8 center = last_raw[sensor_index] >> 4;
+    if (devices_on_bus.alarm_set[sensor_index] && devices_on_bus.alarm_center[sensor_index] == center) return;
+    
+    OneWireTransaction* transaction = &alarm_transactions[sensor_index];
+    
+    /* Reset | MATCH ROM | ADDRESS | WRITE SCRATCHPAD | TH | TL | CONFIG */
+    put_match_rom(transaction, sensor_index);
+    transaction->data[transaction->data_len++] = CMD_WRITE_SCRATCHPAD;
+    transaction->data[transaction->data_len++] = center + SOIL_TEMP_ALARM_BAND;
+    transaction->data[transaction->data_len++] = center - SOIL_TEMP_ALARM_BAND;
+    transaction->data[transaction->data_len++] =
+        ((devices_on_bus.resolution[sensor_index] - SOIL_TEMP_RESOLUTION_MIN) << 5) | 0x1f;
+    
+    if (!onewire_submit(transaction)) return;
+    
+    devices_on_bus.alarm_center[sensor_index] = center;
+    devices_on_bus.alarm_set[sensor_index]    = 1;
+}
+
+#endif
+
+/*
+ * @brief  Advance ALARM SEARCH of the readout by one device.
+ * Single search pass is executed with blocking primitives, found sensors are planned for reading.
+ * Nothing is done while queued transactions are in progress.
+ * @return True once all buses are searched
+ */
+static uint8 alarm_search_step()
+{
+    if (!onewire_engine_idle()) return 0;
+    
+    OneWireBus* bus = &soil_temp_buses[alarm_search_bus];
+    uint64 rom_code;
+    
+    set_speed(bus, STANDARD);
+    int found = alarm_search_first ? onewire_alarm_first(bus, &alarm_search, &rom_code) :
+                                     onewire_next(bus, &alarm_search, &rom_code);
+    alarm_search_first = 0;
+    if (found) {
+        /* Devices missing in the ROM table are left to the rescan */
+        for (uint8 i = 0; i < devices_on_bus.count; i++) {
+            if (devices_on_bus.rom_codes[i] == rom_code && devices_on_bus.bus[i] == alarm_search_bus) {
+                reading_planned[i] = 1;
+                last_cycle_readings++;
+                break;
+            }
+        }
+        return 0;
+    }
+    
+    /* Bus is done, continue with the next one */
+    alarm_search_first = 1;
+    if (++alarm_search_bus < NUMBER_OF_SOIL_TEMP_BUSES) return 0;
+    
+    alarm_search_active = 0;
+    return 1;
+}
+
+/*
+ * @brief Mark planned readings pending, they are validated once the engine is done
+ */
+static void start_planned_readings()
+{
+#if SOIL_TEMP_PARALLEL_BUSES
+    memset(reading_fed, 0, sizeof(reading_fed));
+#endif
+    readout_start = onewire_time();
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        if (!reading_planned[i]) continue;
+        reading_state[i]   = READING_PENDING;
+        reading_retries[i] = 0;
+    }
+}
+
+/*
+ * @brief  Write pending resolution of the sensor with blocking primitives.
+ * Must not be called while a conversion is in progress: the commands would reset the sensor
+ * in the middle of it and status polling would read completion of COPY SCRATCHPAD instead.
+ * TH/TL are recalled from sensor's EEPROM, the scratchpad may hold the alarm band.
+ * Alarm band is programmed again by the next cycle. Resolution stays pending until
+ * the write succeeds, so a failed write is retried before the next conversion.
+ * @param  sensor_index Target sensor
+ * @return              True if the resolution was written or nothing was pending
+ */
+static uint8 write_resolution(uint8 sensor_index)
+{
+    uint8 resolution = devices_on_bus.pending_resolution[sensor_index];
+    if (!resolution) return 1;
+    
+    /* RECALL E2, sensor answers with 1 once TH/TL/CONFIG are back in the scratchpad */
+    OneWireBus* bus = sensor_bus(sensor_index);
+    if (!select_sensor(sensor_index)) return 0;
+    onewire_write_byte(bus, CMD_RECALL_EEPROM);
+    for (uint8 i = 0; i < SCRATCHPAD_RECALL_POLLS && !onewire_read_bit(bus); i++);
+    
+    /* Alarm registers are written together with configuration, keep them */
+    uint8 scratchpad[SCRATCHPAD_LEN];
+    if (!read_scratchpad(sensor_index, scratchpad)) return 0;
+    
+    /* WRITE SCRATCHPAD | TH | TL | CONFIG */
+    if (!select_sensor(sensor_index)) return 0;
+    onewire_write_byte(bus, CMD_WRITE_SCRATCHPAD);
+    onewire_write_byte(bus, scratchpad[SCRATCHPAD_TH]);
+    onewire_write_byte(bus, scratchpad[SCRATCHPAD_TL]);
+    onewire_write_byte(bus, ((resolution - SOIL_TEMP_RESOLUTION_MIN) << 5) | 0x1f);
+    
+    /* COPY SCRATCHPAD, wait for EEPROM write to complete */
+    if (!select_sensor(sensor_index)) return 0;
+    onewire_write_byte(bus, CMD_COPY_SCRATCHPAD);
+    CyDelay(SCRATCHPAD_COPY_TIME_MS);
+    
+    devices_on_bus.resolution[sensor_index]         = resolution;
+    devices_on_bus.pending_resolution[sensor_index] = 0;
+    devices_on_bus.alarm_set[sensor_index]          = 0;
+    return 1;
+}
+
+/*
+ * @brief  Start conversion on all sensors at once.
+ * Single SKIP ROM command is broadcasted, thus bus time does not depend on number of sensors.
+ * Every SOIL_TEMP_PROFILE_PERIOD cycle single sensor is converted instead to profile its conversion time.
+ * Pending resolutions are written first, the call then blocks for the EEPROM copy of the sensors.
+ * @return True if the conversion was queued
+ */
+uint8 plan_soil_temp_conversion()
+{
+    /* No conversion is in progress, write resolutions requested during the previous cycle */
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        write_resolution(i);
+    }
+    
+#if SOIL_TEMP_ALARM_READOUT
+    /* Move alarm bands of the sensors read in the previous cycle, before they convert.
+       Bands that did not fit the queue in the previous cycle are moved as well */
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        queue_alarm_band(i);
+    }
+#endif
+    
+    cycle_start_time  = onewire_bus_time();
+    cycle_in_progress = 1;
+    conversion_start  = onewire_time();
+    for (uint8 b = 0; b < NUMBER_OF_SOIL_TEMP_BUSES; b++) {
+        conversion_poll[b].status = ONEWIRE_TR_IDLE;
+        bus_converting[b] = 0;
+    }
+    
+#if SOIL_TEMP_ADAPTIVE_CONVERSION
+    /* Profiling cycle, round robin over the sensors */
+    if (++cycle_number % SOIL_TEMP_PROFILE_PERIOD == 0 && devices_on_bus.count) {
+        profiled_sensor = (cycle_number / SOIL_TEMP_PROFILE_PERIOD) % devices_on_bus.count;
+        bus_converting[devices_on_bus.bus[profiled_sensor]] = 1;
+        return queue_conversion_soil_temp_sensor(profiled_sensor);
+    }
+#endif
+    profiled_sensor = NUMBER_OF_SOIL_TEMP_SENSORS;
+    
+#if SOIL_TEMP_PARALLEL_BUSES
+    /* Reset | SKIP ROM | CONVERT on all buses by one parallel transaction */
+    parallel_conversion.port     = &soil_temp_port;
+    parallel_conversion.lines    = soil_temp_port.lines;
+    parallel_conversion.reset    = 1;
+    parallel_conversion.data_len = 2;
+    memset(parallel_conversion.data[0], CMD_ROM_SKIP, ONEWIRE_PARALLEL_LINES);
+    memset(parallel_conversion.data[1], CMD_CONVERT_TEMP, ONEWIRE_PARALLEL_LINES);
+    memset(bus_converting, 1, sizeof(bus_converting));
+    
+    return onewire_submit_parallel(&parallel_conversion);
+#else
+    /* Reset | SKIP ROM | CONVERT on every bus */
+    uint8 result = 1;
+    for (uint8 b = 0; b < NUMBER_OF_SOIL_TEMP_BUSES; b++) {
+        OneWireTransaction* transaction = &broadcast_conversion[b];
+        transaction->bus = &soil_temp_buses[b];
+        transaction->reset = 1;
+        transaction->overdrive = 0;
+        transaction->data[0] = CMD_ROM_SKIP;
+        transaction->data[1] = CMD_CONVERT_TEMP;
+        transaction->data_len = 2;
+        
+        bus_converting[b] = 1;
+        result &= onewire_submit(transaction);
+    }
     
-    // Get the result as floating point number
-    int   decimal  = ((msb & 0x07) << 4) | (lsb >> 4);
-    float floating = ((lsb & 0x01) >> 0) * (1 / 16.0) +
-                     ((lsb & 0x02) >> 1) * (1 / 8.0)  +
-                     ((lsb & 0x04) >> 2) * (1 / 4.0)  +
-                     ((lsb & 0x08) >> 3) * (1 / 2.0);
-    float result = decimal + floating;
-    if (msb & 0x80) result *= -1; // Determine sign
-                                      
     return result;
+#endif
 }
 
 /*
- * @brief Initiate DS1822 conversion
- * @param sensor_index Sensor to read from
+ * @brief  Poll conversion status started by plan_soil_temp_conversion().
+ * Read time slots are issued every SOIL_TEMP_POLL_PERIOD_US, sensors pull them low until conversion is done.
+ * @return True once all converting sensors on all buses have finished
  */
-void start_conversion_soil_temp_sensor(uint8 sensor_index)
+uint8 soil_temp_conversion_done()
 {
-    set_speed();
+    uint8 done = 1;
+    uint8 poll = onewire_time() - last_poll_time >= SOIL_TEMP_POLL_PERIOD_US;
     
-    // Detect presence
-    if (onewire_touch_reset()) return;
+    for (uint8 b = 0; b < NUMBER_OF_SOIL_TEMP_BUSES; b++) {
+        OneWireTransaction* transaction = &conversion_poll[b];
+        if (!bus_converting[b]) continue;
+        
+        /* Any released slot means the conversion on the bus has finished */
+        if (transaction->status == ONEWIRE_TR_DONE && transaction->data[0]) {
+            bus_converting[b] = 0;
+            continue;
+        }
+        done = 0;
+        
+        // Previous poll is still in progress
+        if (transaction->status == ONEWIRE_TR_QUEUED) continue;
+        
+        /* Read time slots directly after CONVERT T, no reset is allowed in between */
+        if (transaction->status == ONEWIRE_TR_IDLE || poll) {
+            transaction->bus = &soil_temp_buses[b];
+            transaction->reset = 0;
+            transaction->overdrive = 0;
+            transaction->data[0] = 0xff;
+            transaction->data_len = 1;
+            onewire_submit(transaction);
+        }
+    }
+    if (poll) last_poll_time = onewire_time();
+    if (!done) return 0;
     
-    /* Issue match ROM command and write the device address */
-    onewire_write_byte(CMD_ROM_MATCH);
-    /* LSB->MSB device address */
-    for (uint8_t i = 0; i < 8; i++) {
-        uint8_t to_send = devices_on_bus.rom_codes[sensor_index] >> (8 * i);
-        onewire_write_byte(to_send);
+    last_conversion_time = (onewire_time() - conversion_start) / 1000;
+    if (profiled_sensor < NUMBER_OF_SOIL_TEMP_SENSORS) {
+        devices_on_bus.conversion_time[profiled_sensor] = last_conversion_time;
+    }
+    
+    return 1;
+}
+
+/*
+ * @brief Plan reading of all sensors as one sequence.
+ * Only the profiled sensor is read in profiling cycle, the rest keeps previous results.
+ * In alarm readout mode only sensors in alarm state are read, unless full readout is due.
+ * ALARM SEARCH is then advanced by one device per soil_temp_sensors_busy() call.
+ * Readings are fed to the engine by soil_temp_sensors_busy(), results are available
+ * with get_queued_soil_temperature() once the sensors are not busy.
+ */
+void plan_soil_temp_readout()
+{
+    memset(reading_planned, 0, sizeof(reading_planned));
+    
+    if (profiled_sensor < NUMBER_OF_SOIL_TEMP_SENSORS) {
+        planned_readings     = profiled_sensor;
+        planned_readings_end = profiled_sensor + 1;
+        reading_planned[profiled_sensor] = 1;
+        last_cycle_readings  = 1;
+    }
+    else {
+        planned_readings     = 0;
+        planned_readings_end = devices_on_bus.count;
+        
+#if SOIL_TEMP_ALARM_READOUT
+        /* Sensors without alarm band and periodic refresh require full readout */
+        uint8 full_readout = ++readouts_since_refresh >= SOIL_TEMP_ALARM_REFRESH_PERIOD;
+        for (uint8 i = 0; i < devices_on_bus.count; i++) {
+            if (!devices_on_bus.alarm_set[i]) full_readout = 1;
+        }
+        
+        /* Sensors in alarm state are planned by ALARM SEARCH advanced by soil_temp_sensors_busy() */
+        if (!full_readout) {
+            last_cycle_readings = 0;
+            alarm_search_active = 1;
+            alarm_search_first  = 1;
+            alarm_search_bus    = 0;
+            return;
+        }
+#endif
+        memset(reading_planned, 1, sizeof(reading_planned));
+        last_cycle_readings    = devices_on_bus.count;
+        readouts_since_refresh = 0;
     }
     
-    // Issue conversion command to sample the temperature
-    onewire_write_byte(CMD_CONVERT_TEMP);
+    start_planned_readings();
+    soil_temp_sensors_busy();
+}
+
+/*
+ * @brief  Get bus time spent by the last completed cycle (conversion and readout)
+ * @return Bus time in microseconds
+ */
+uint32 get_soil_temp_cycle_bus_time()
+{
+    return last_cycle_bus_time;
+}
+
+/*
+ * @brief  Get number of sensors read in the last cycle
+ * @return Number of readings
+ */
+uint8 get_soil_temp_cycle_readings()
+{
+    return last_cycle_readings;
+}
+
+/*
+ * @brief  Get number of scratchpad reads of the sensor that failed validation
+ * @param  sensor_index Target sensor
+ * @return              Number of errors
+ */
+uint16 get_soil_temp_read_errors(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    return devices_on_bus.read_errors[sensor_index];
+}
+
+/*
+ * @brief  Get number of readings of the sensor given up after all retries
+ * @param  sensor_index Target sensor
+ * @return              Number of failures
+ */
+uint16 get_soil_temp_read_failures(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    return devices_on_bus.read_failures[sensor_index];
+}
+
+/*
+ * @brief  Get conversion time observed during the last profiling of the sensor
+ * @param  sensor_index Target sensor
+ * @return              Conversion time in ms, 0 if not yet profiled
+ */
+uint16 get_soil_temp_conversion_time(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    return devices_on_bus.conversion_time[sensor_index];
+}
+
+/*
+ * @brief  Get conversion time observed in the last cycle
+ * @return Conversion time in ms
+ */
+uint16 get_soil_temp_cycle_conversion_time()
+{
+    return last_conversion_time;
+}
+
+/*
+ * @brief  Configure conversion resolution of the sensor.
+ * Resolution is written before the next conversion is started by plan_soil_temp_conversion(),
+ * it is copied to the sensor's EEPROM and is restored on the next power up.
+ * @param  sensor_index Target sensor
+ * @param  resolution   Resolution in bits, SOIL_TEMP_RESOLUTION_MIN-SOIL_TEMP_RESOLUTION_MAX
+ * @return              True if the resolution was accepted
+ */
+uint8 set_soil_temp_resolution(uint8 sensor_index, uint8 resolution)
+{
+    // Sanity checks
+    if (sensor_index >= devices_on_bus.count) return 0;
+    if (resolution < SOIL_TEMP_RESOLUTION_MIN || resolution > SOIL_TEMP_RESOLUTION_MAX) return 0;
+    
+    devices_on_bus.pending_resolution[sensor_index] = resolution;
+    return 1;
+}
+
+/*
+ * @brief  Get conversion resolution of the sensor
+ * @param  sensor_index Target sensor
+ * @return              Resolution in bits, 0 if the sensor does not exist
+ */
+uint8 get_soil_temp_resolution(uint8 sensor_index)
+{
+    // Sanity check
+    if (sensor_index >= devices_on_bus.count) return 0;
+    
+    return devices_on_bus.resolution[sensor_index];
+}
+
+/*
+ * @brief  Get worst case conversion time of the slowest configured sensor.
+ * Conversion time halves with every bit of resolution removed, 750 ms for 12 bits.
+ * @return Conversion time in ms
+ */
+uint16 get_soil_temp_max_conversion_time()
+{
+    uint8 resolution = SOIL_TEMP_RESOLUTION_MIN;
+    for (uint8 i = 0; i < devices_on_bus.count; i++) {
+        if (devices_on_bus.resolution[i] > resolution) resolution = devices_on_bus.resolution[i];
+    }
+    
+    // Round up, 9 bits is 93.75 ms
+    return (SOIL_TEMP_MAX_CONVERSION_MS + (1 << (SOIL_TEMP_RESOLUTION_MAX - resolution)) - 1) >>
+           (SOIL_TEMP_RESOLUTION_MAX - resolution);
+}
+
+/*
+ * @brief  Get number of sensors found on the buses
+ * @return Number of sensors in the ROM table
+ */
+uint8 get_soil_temp_sensor_count()
+{
+    return devices_on_bus.count;
+}
+
+/*
+ * @brief Start background rescan of all buses.
+ * Rescan is advanced by soil_temp_rescan_step().
+ */
+void start_soil_temp_rescan()
+{
+    if (rescan_active) return;
+    
+    rescan_active = 1;
+    rescan_first  = 1;
+    rescan_bus    = 0;
+    rescan_count  = 0;
+}
+
+/*
+ * @brief  Advance background rescan by one device.
+ * Single search pass is executed, so the call blocks for one ROM search only.
+ * Nothing is done while the planned cycle or queued transactions are in progress.
+ * Once all buses are scanned, changed sensor set replaces the ROM table and the cache.
+ * @return True if the sensor set has changed, indexes of the sensors may be different
+ */
+uint8 soil_temp_rescan_step()
+{
+    if (!rescan_active || cycle_in_progress || !onewire_engine_idle()) return 0;
+    
+    if (rescan_count < NUMBER_OF_SOIL_TEMP_SENSORS) {
+        OneWireBus* bus = &soil_temp_buses[rescan_bus];
+        set_speed(bus, STANDARD);
+        
+        int found = rescan_first ? onewire_first(bus, &rescan_search, &rescan_rom_codes[rescan_count]) :
+                                   onewire_next(bus, &rescan_search, &rescan_rom_codes[rescan_count]);
+        rescan_first = 0;
+        if (found) {
+            rescan_buses[rescan_count++] = rescan_bus;
+            return 0;
+        }
+    }
+    
+    /* Bus is done, continue with the next one */
+    rescan_first = 1;
+    if (++rescan_bus < NUMBER_OF_SOIL_TEMP_BUSES && rescan_count < NUMBER_OF_SOIL_TEMP_SENSORS) return 0;
+    rescan_active = 0;
+    
+    /* Compare with the current table */
+    uint8 changed = rescan_count != devices_on_bus.count;
+    for (uint8 i = 0; i < rescan_count && !changed; i++) {
+        changed = rescan_rom_codes[i] != devices_on_bus.rom_codes[i] || rescan_buses[i] != devices_on_bus.bus[i];
+    }
+    if (!changed) return 0;
+    
+    /* Adopt new sensor set */
+    devices_on_bus.count = rescan_count;
+    memcpy(devices_on_bus.rom_codes, rescan_rom_codes, sizeof(rescan_rom_codes));
+    memcpy(devices_on_bus.bus, rescan_buses, sizeof(rescan_buses));
+    configure_sensors();
+    save_rom_table();
+    
+    return 1;
 }
 
 /* [] END OF FILE */
@@ -12,7 +12,40 @@
  *
  * During initialization, all the sensor found on the bus are stored in
  * devices_on_bus structure that is later accessed by public interface functions.
- * To alter number of sensor present on OneWire bus, change NUMBER_OF_SOIL_TEMP_SENSORS parameter.
+ * NUMBER_OF_SOIL_TEMP_SENSORS is the capacity of the table, number of sensors is found at runtime.
+ * The table is cached in EEPROM and verified by background rescan.
+ *
+ * Sensors can be split over several OneWire buses, each bus keeps its own chain of sensors.
+ * Buses are listed in soil_temp_buses, sensors are enumerated bus by bus.
+ *
+ * Conversion and reading can be queued to OneWire background engine instead of
+ * being executed inline. Queued results are collected once soil_temp_sensors_busy() reports false.
+ *
+ * Every device is probed for overdrive support during initialization. Overdrive capable devices
+ * are addressed with OVERDRIVE MATCH ROM by the queued interface, the rest stays at standard speed.
+ *
+ * Resolution of every sensor (9-12 bits) can be configured to trade precision for conversion time.
+ * New resolution is written to the sensor before the next conversion, never during one.
+ * Temperatures are reported as int16 fixed point with SOIL_TEMP_FRACTION_BITS fractional bits (1/16 C),
+ * the native format of the scratchpad, so no floating point is involved.
+ * The conversion is waited for the slowest configured sensor.
+ *
+ * With SOIL_TEMP_ALARM_READOUT alarm registers are programmed around the last reading, only
+ * sensors found by ALARM SEARCH are read in the cycle.
+ *
+ * Transaction planner organizes the bus cycle: conversion is started on all sensors at once
+ * with a single SKIP ROM command, readings of all sensors are fed to the engine as one sequence.
+ * Bus time spent by the last planned cycle is tracked for diagnostics.
+ *
+ * With SOIL_TEMP_PARALLEL_BUSES the buses are lines of one Pins component. Conversion is started
+ * on all of them by one parallel transaction and the readout reads one sensor of every bus per
+ * parallel transaction, so the cycle takes the bus time of the longest chain.
+ *
+ * In adaptive mode (SOIL_TEMP_ADAPTIVE_CONVERSION) the planner polls conversion status with read
+ * time slots right after CONVERT T. Slots are wired-AND on the bus, so the readout can start as soon
+ * as the slowest sensor has finished. Conversion time of individual sensors can not be observed
+ * on broadcast conversion, thus every SOIL_TEMP_PROFILE_PERIOD cycle converts and reads a single
+ * sensor (round robin) with MATCH ROM to measure its time. Polling requires external power supply of the sensors.
  *
  * ========================================
 */
@@ -23,17 +56,83 @@
     
 #include "onewire.h"
     
-#define NUMBER_OF_SOIL_TEMP_SENSORS 2
+#define NUMBER_OF_SOIL_TEMP_SENSORS 2  // Capacity of the ROM table, maximum number of sensors
+#define NUMBER_OF_SOIL_TEMP_BUSES   1  // Number of OneWire buses listed in soil_temp_buses
+#define SOIL_TEMP_PARALLEL_BUSES    0  // Buses are lines 0..N-1 of one Pins component, driven in lockstep
+
+#define SOIL_TEMP_ADAPTIVE_CONVERSION 1      // Poll conversion status instead of waiting worst case time
+#define SOIL_TEMP_POLL_PERIOD_US      10000  // Period of conversion status polling
+#define SOIL_TEMP_PROFILE_PERIOD      16     // Every Nth cycle converts single sensor to measure its time
+
+#define SOIL_TEMP_FRACTION_BITS       4      // Temperatures are int16 fixed point in 1/16 C, as reported by DS18B20
+#define SOIL_TEMP_RESOLUTION_MIN      9      // Resolution in bits, 94 ms conversion
+#define SOIL_TEMP_RESOLUTION_MAX      12     // Resolution in bits, 750 ms conversion
+#define SOIL_TEMP_MAX_CONVERSION_MS   750    // Conversion time at maximum resolution
+
+#define SOIL_TEMP_RESCAN_PERIOD_MIN   5      // Period of background bus rescan in minutes
+
+#define SOIL_TEMP_ALARM_READOUT        1     // Read only sensors found by ALARM SEARCH
+#define SOIL_TEMP_ALARM_BAND           1     // Alarm is raised when integer temperature moves by this amount, C
+#define SOIL_TEMP_ALARM_REFRESH_PERIOD 4     // Every Nth readout reads all sensors, bounds latency of sub-degree changes
+
+/* ROM table cache, placed by eeprom_layout.h: MAGIC | COUNT | (ROM CODE[8] | BUS) * NUMBER_OF_SOIL_TEMP_SENSORS */
+#define SOIL_TEMP_ROM_TABLE_MAGIC     0x5a
+#define SOIL_TEMP_ROM_ENTRY_LEN       9
+#define SOIL_TEMP_ROM_TABLE_SIZE      (2 + SOIL_TEMP_ROM_ENTRY_LEN * NUMBER_OF_SOIL_TEMP_SENSORS)
+
+#define SOIL_TEMP_READ_RETRIES          3     // Additional attempts after failed scratchpad validation
+#define SOIL_TEMP_RETRY_BUDGET_US       50000 // Time budget for retries of queued readout
+
+/* Scratchpad layout */
+#define SCRATCHPAD_LEN           9
+#define SCRATCHPAD_TEMP_LSB      0
+#define SCRATCHPAD_TEMP_MSB      1
+#define SCRATCHPAD_POWER_ON_TEMP 0x0550  // 85 C, temperature register was never converted
+#define SCRATCHPAD_TH            2
+#define SCRATCHPAD_TL            3
+#define SCRATCHPAD_CONFIG        4
+#define SCRATCHPAD_COPY_TIME_MS  10
+#define SCRATCHPAD_RECALL_POLLS  100  // Read time slots waited for RECALL E2, about 7 ms
 
 /* Structures and types */
 typedef struct slaves_information {
+    uint8    count;                                   // Number of devices found on the buses
     uint64_t rom_codes[NUMBER_OF_SOIL_TEMP_SENSORS];
+    uint8    bus[NUMBER_OF_SOIL_TEMP_SENSORS];        // Index of the bus the device is connected to
+    uint8    overdrive[NUMBER_OF_SOIL_TEMP_SENSORS];  // Device negotiated overdrive speed
+    uint16   conversion_time[NUMBER_OF_SOIL_TEMP_SENSORS];  // Observed conversion time, ms
+    uint8    resolution[NUMBER_OF_SOIL_TEMP_SENSORS];       // Configured resolution, bits
+    uint8    pending_resolution[NUMBER_OF_SOIL_TEMP_SENSORS];  // Resolution waiting for the next cycle, 0 if none
+    int8     alarm_center[NUMBER_OF_SOIL_TEMP_SENSORS];     // Integer temperature TH/TL are programmed around, C
+    uint8    alarm_set[NUMBER_OF_SOIL_TEMP_SENSORS];        // TH/TL are programmed around the last reading
+    uint16   read_errors[NUMBER_OF_SOIL_TEMP_SENSORS];      // Scratchpad reads that failed validation
+    uint16   read_failures[NUMBER_OF_SOIL_TEMP_SENSORS];    // Readings given up after all retries
 } slaves_info;
 
 /* Function declarations */
 void  initialize_soil_temp_sensors();
-float get_soil_temperature(uint8 sensor_index);
-void  start_conversion_soil_temp_sensor(uint8 sensor_index);
+uint8 queue_conversion_soil_temp_sensor(uint8 sensor_index);
+uint8 queue_reading_soil_temp_sensor(uint8 sensor_index);
+uint8 soil_temp_sensors_busy();
+uint8 get_queued_soil_temperature(uint8 sensor_index, int16* temperature);
+/* Transaction planner */
+uint8  plan_soil_temp_conversion();
+void   plan_soil_temp_readout();
+uint32 get_soil_temp_cycle_bus_time();
+uint8  soil_temp_conversion_done();
+uint16 get_soil_temp_conversion_time(uint8 sensor_index);
+uint16 get_soil_temp_cycle_conversion_time();
+uint8  get_soil_temp_cycle_readings();
+uint16 get_soil_temp_read_errors(uint8 sensor_index);
+uint16 get_soil_temp_read_failures(uint8 sensor_index);
+/* Enumeration */
+uint8  get_soil_temp_sensor_count();
+void   start_soil_temp_rescan();
+uint8  soil_temp_rescan_step();
+/* Resolution */
+uint8  set_soil_temp_resolution(uint8 sensor_index, uint8 resolution);
+uint8  get_soil_temp_resolution(uint8 sensor_index);
+uint16 get_soil_temp_max_conversion_time();
     
 
 #endif /* [] END OF FILE */
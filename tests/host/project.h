@@ -0,0 +1,28 @@
+/* ========================================
+ *
+ * @name    Host test stub of the PSoC Creator project header
+ *
+ * Filters are plain C, only the integer types of cytypes.h are required
+ * to build them on the host.
+ *
+ * ========================================
+ */
+
+#ifndef PROJECT_H
+#define PROJECT_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t  uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef uint64_t uint64;
+typedef int8_t   int8;
+typedef int16_t  int16;
+typedef int32_t  int32;
+typedef int64_t  int64;
+
+
+#endif
@@ -0,0 +1,184 @@
+/* ========================================
+ *
+ * @name    Host test of the CIC filter
+ *
+ * Synthetic ADC streams are fed through CicFilter with the decimation of the
+ * moisture path (ADC_DECIMATION of main.c):
+ *   DC step:       output settles to the new level within CIC_STAGES outputs, without overshoot
+ *   Noise:         alternating and random noise around DC is rejected
+ *   Wrap:          full scale samples wrap the int32 integrators, outputs match exact
+ *                  int64 cascade of boxcar sums bit for bit
+ *   Throughput:    input samples per second on the host
+ *
+ * ========================================
+ */
+
+#include "average_filter.h"
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+
+#define TEST_DECIMATION 256  // ADC_DECIMATION of main.c
+#define FULL_SCALE      127  // Largest |sample| with FULL_SCALE * TEST_DECIMATION^3 within int32
+
+static uint32 rng_state = 0x2545f491;
+static uint32 failures  = 0;
+
+// Xorshift32 generator, deterministic between runs
+static uint32 next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fail(const char* test, uint32 output, int32 expected, int32 actual)
+{
+    if (failures++ < 10) {
+        printf("FAIL %s at output %u: expected %d, got %d\n", test, output, expected, actual);
+    }
+}
+
+/*
+ * @brief Output settles to the new level within CIC_STAGES outputs and moves monotonically
+ */
+static void test_dc_step()
+{
+    CicFilter filter;
+    init_cic_filter(&filter, TEST_DECIMATION);
+    
+    /* DC from empty filter, warm up average is exact */
+    for (uint32 n = 0; n < 8 * TEST_DECIMATION; n++) {
+        if (add_sample_to_cic_filter(&filter, 20) && get_cic_filtered_result(&filter) != 20) {
+            fail("dc", n / TEST_DECIMATION, 20, get_cic_filtered_result(&filter));
+        }
+    }
+    
+    /* Step 20 -> 100 */
+    int32 previous = 20;
+    for (uint32 n = 0; n < 8 * TEST_DECIMATION; n++) {
+        if (!add_sample_to_cic_filter(&filter, 100)) continue;
+        
+        uint32 output = n / TEST_DECIMATION;
+        int32 result = get_cic_filtered_result(&filter);
+        if (result < previous || result > 100) fail("step monotonic", output, previous, result);
+        if (output >= CIC_STAGES - 1 && result != 100) fail("step settled", output, 100, result);
+        previous = result;
+    }
+}
+
+/*
+ * @brief Noise around DC is rejected.
+ * Alternating noise cancels exactly over even decimation, random noise is attenuated
+ */
+static void test_noise()
+{
+    CicFilter filter;
+    init_cic_filter(&filter, TEST_DECIMATION);
+    
+    /* 50 % with alternating +-50 %, the ADC toggling between 0 and 100 */
+    for (uint32 n = 0; n < 64 * TEST_DECIMATION; n++) {
+        if (add_sample_to_cic_filter(&filter, n & 1 ? 100 : 0) && get_cic_filtered_result(&filter) != 50) {
+            fail("alternating noise", n / TEST_DECIMATION, 50, get_cic_filtered_result(&filter));
+        }
+    }
+    
+    /* 50 % with uniform noise of +-25 % */
+    double input_power  = 0;
+    double output_power = 0;
+    uint32 outputs      = 0;
+    for (uint32 n = 0; n < 4096 * TEST_DECIMATION; n++) {
+        int32 sample = 50 + (int32)(next_random() % 51) - 25;
+        input_power += (double)(sample - 50) * (sample - 50);
+        if (!add_sample_to_cic_filter(&filter, sample)) continue;
+        
+        int32 deviation = get_cic_filtered_result(&filter) - 50;
+        output_power += (double)deviation * deviation;
+        outputs++;
+    }
+    input_power  /= 4096 * TEST_DECIMATION;
+    output_power /= outputs;
+    
+    // Output is truncated to integer, its rms includes up to 1 % of quantization
+    double rejection = 10 * log10(input_power / output_power);
+    printf("  random noise +-25 around 50: rms %.2f -> %.2f, rejection %.1f dB\n",
+           sqrt(input_power), sqrt(output_power), rejection);
+    if (rejection < 20) fail("random noise rejection, dB", outputs, 20, (int32)rejection);
+}
+
+/*
+ * @brief Integrators wrap modulo 2^32, outputs still match the exact cascade.
+ * Reference keeps CIC_STAGES moving sums of TEST_DECIMATION values in int64, which never wrap.
+ */
+static void test_wrap()
+{
+    static int64 history[CIC_STAGES][TEST_DECIMATION];
+    int64  sums[CIC_STAGES] = { 0 };
+    CicFilter filter;
+    init_cic_filter(&filter, TEST_DECIMATION);
+    
+    const int64 gain = (int64)TEST_DECIMATION * TEST_DECIMATION * TEST_DECIMATION;
+    uint32 output = 0;
+    uint32 wraps  = 0;
+    for (uint32 n = 0; n < 40000 * TEST_DECIMATION; n++) {
+        int32 sample;
+        /* Full scale DC both ways, then full scale random */
+        if (n < 10000 * TEST_DECIMATION)      sample = FULL_SCALE;
+        else if (n < 20000 * TEST_DECIMATION) sample = -FULL_SCALE;
+        else                                  sample = (int32)(next_random() % (2 * FULL_SCALE + 1)) - FULL_SCALE;
+        
+        /* Cascade of boxcar sums */
+        int64 value = sample;
+        for (uint8 i = 0; i < CIC_STAGES; i++) {
+            sums[i] += value - history[i][n % TEST_DECIMATION];
+            history[i][n % TEST_DECIMATION] = value;
+            value = sums[i];
+        }
+        
+        // Last integrator only grows on positive DC, every decrease is a wrap
+        uint32 integrator = filter.integrators[CIC_STAGES - 1];
+        uint8  produced   = add_sample_to_cic_filter(&filter, sample);
+        if (sample > 0 && filter.integrators[CIC_STAGES - 1] < integrator) wraps++;
+        if (!produced) continue;
+        
+        // Cascade is filled after CIC_STAGES outputs, division truncates toward zero as the filter does
+        if (++output >= CIC_STAGES && get_cic_filtered_result(&filter) != (int32)(value / gain)) {
+            fail("wrap", output, (int32)(value / gain), get_cic_filtered_result(&filter));
+        }
+    }
+    printf("  last integrator wrapped %u times on full scale DC\n", wraps);
+    if (wraps == 0) fail("wrap count", output, 1, 0);
+}
+
+/*
+ * @brief Measure input samples per second on the host
+ */
+static void test_throughput()
+{
+    CicFilter filter;
+    init_cic_filter(&filter, TEST_DECIMATION);
+    
+    const uint32 samples = 100000000;
+    int32 checksum = 0;
+    clock_t start = clock();
+    for (uint32 n = 0; n < samples; n++) {
+        if (add_sample_to_cic_filter(&filter, n & 0x3f)) checksum += get_cic_filtered_result(&filter);
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    printf("  throughput %.1f Msamples/s (checksum %d)\n", samples / seconds / 1e6, checksum);
+}
+
+int main()
+{
+    printf("CIC filter, %d stages, decimation %d\n", CIC_STAGES, TEST_DECIMATION);
+    
+    test_dc_step();
+    test_noise();
+    test_wrap();
+    test_throughput();
+    
+    printf(failures ? "FAILED, %u mismatches\n" : "PASSED\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,115 @@
+/* ========================================
+ *
+ * @name    Host test of moving average filter banks
+ *
+ * Runs TEST_SAMPLES pseudo random samples through the filter banks used by the
+ * firmware. Periodically and at the end the windows are re-summed and compared to
+ * the running sums, so any drift of the O(1) update shows up as a mismatch.
+ * Every result is checked to be the exact average of the window rounded half away from zero,
+ * whether it was divided or shifted.
+ *
+ * ========================================
+ */
+
+#include "moving_average_filter.h"
+#include <stdio.h>
+
+#define CHECK_PERIOD (1ul << 16)  // Samples between window re-sums
+
+/* Banks as configured in main.c */
+DECLARE_MA_FILTER_BANK(MoistureBank, moisture, uint8, uint16, 4, 32);
+DEFINE_MA_FILTER_BANK(MoistureBank, moisture, uint8, uint16, 4, 32)
+DECLARE_MA_FILTER_BANK(SoilTempBank, soil_temp, int16, int32, 2, 32);
+DEFINE_MA_FILTER_BANK(SoilTempBank, soil_temp, int16, int32, 2, 32)
+
+static uint32 rng_state = 0x12345678;
+static uint32 failures  = 0;
+
+// Xorshift32 generator, deterministic between runs
+static uint32 next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fail(const char* filter, uint64 sample, const char* what, int64 expected, int64 actual)
+{
+    if (failures++ < 10) {
+        printf("FAIL %s at sample %llu: %s expected %lld, got %lld\n",
+               filter, (unsigned long long)sample, what, (long long)expected, (long long)actual);
+    }
+}
+
+// Result must be the window average rounded half away from zero
+static void check_average(const char* filter, uint64 sample, int64 sum, uint32 count, int64 result)
+{
+    if (count == 0) {
+        if (result != 0) fail(filter, sample, "empty result", 0, result);
+        return;
+    }
+    int64 expected = sum >= 0 ? (sum + count / 2) / count : -((count / 2 - sum) / count);
+    if (result != expected) fail(filter, sample, "average", expected, result);
+}
+
+/*
+ * @brief Check running sums and counts of the bank against re-summed windows
+ */
+#define CHECK_BANK(name, bank, sample_type, channels, length, sample)                           \
+do {                                                                                            \
+    sample_type results[channels];                                                              \
+    get_##name##_bank_results(bank, results);                                                   \
+    for (uint8 c = 0; c < (channels); c++) {                                                    \
+        int64  window_sum = 0;                                                                  \
+        uint32 count = 0;                                                                       \
+        for (uint32 i = 0; i < (length); i++) {                                                 \
+            window_sum += (bank)->samples_windows[i][c];                                        \
+            count += ((bank)->valid_masks[i][c / 8] >> (c % 8)) & 1;                            \
+        }                                                                                       \
+        if ((bank)->sums[c] != window_sum) fail(#name, sample, "sum", window_sum, (bank)->sums[c]);\
+        if ((bank)->sample_counts[c] != count)                                                  \
+            fail(#name, sample, "sample count", count, (bank)->sample_counts[c]);               \
+        check_average(#name, sample, window_sum, count, results[c]);                            \
+    }                                                                                           \
+} while (0)
+
+static void test_moisture_bank()
+{
+    static MoistureBank bank;
+    reset_moisture_bank(&bank);
+    
+    for (uint64 n = 1; n <= TEST_SAMPLES; n++) {
+        uint32 random = next_random();
+        uint8  samples[4] = { random % 101, (random >> 8) % 101, (random >> 16) % 101, (random >> 24) % 101 };
+        // Roughly one sample in eight is missing
+        add_samples_to_moisture_bank(&bank, samples, ~(random >> 5) | (random >> 17));
+        
+        if (n % CHECK_PERIOD == 0 || n == TEST_SAMPLES) CHECK_BANK(moisture, &bank, uint8, 4, 32, n);
+    }
+}
+
+static void test_soil_temp_bank()
+{
+    static SoilTempBank bank;
+    reset_soil_temp_bank(&bank);
+    
+    for (uint64 n = 1; n <= TEST_SAMPLES; n++) {
+        uint32 random = next_random();
+        int16  samples[2] = { (int16)random, (int16)(random >> 16) };
+        add_samples_to_soil_temp_bank(&bank, samples, (random >> 3) & (random >> 11) & 0x03 ? 0x03 : 0x01);
+        
+        if (n % CHECK_PERIOD == 0 || n == TEST_SAMPLES) CHECK_BANK(soil_temp, &bank, int16, 2, 32, n);
+    }
+}
+
+int main()
+{
+    printf("Moving average filter banks, %llu samples each\n", (unsigned long long)TEST_SAMPLES);
+    
+    test_moisture_bank();
+    test_soil_temp_bank();
+    
+    printf(failures ? "FAILED, %u mismatches\n" : "PASSED\n", failures);
+    return failures != 0;
+}